@@ -8,154 +8,345 @@
 
 #include "analyze.h"
 // #include "globals.h"
-#include "symtab.h"
-
-/* counter for variable memory locations */
-static int location = 0;
+#include <limits.h>
 
-/* Procedure traverse is a generic recursive
- * syntax tree traversal routine:
- * it applies preProc in preorder and postProc
- * in postorder to tree pointed to by t
- */
-static void traverse(TreeNode *t, void (*preProc)(TreeNode *),
-                     void (*postProc)(TreeNode *)) {
-    if (t != NULL) {
-        preProc(t);
-        {
-            int i;
-            for (i = 0; i < MAXCHILDREN; i++)
-                traverse(t->child[i], preProc, postProc);
-        }
-        postProc(t);
-        traverse(t->sibling, preProc, postProc);
-    }
-}
+#include "compiler.h"
+#include "symtab.h"
 
-/* nullProc is a do-nothing procedure to
- * generate preorder-only or postorder-only
- * traversals from traverse
- */
-static void nullProc(TreeNode *t) {
-    if (t == NULL)
-        return;
-    else
-        return;
+static void outOfMemory(Compiler *ctx) {
+    outPrintf(&ctx->listing, "Out of memory error in analysis\n");
+    ctx->Error = TRUE;
 }
 
-/* Procedure insertNode inserts
- * identifiers stored in t into
- * the symbol table
- */
-static void insertNode(TreeNode *t) {
-    switch (t->nodekind) {
+/* symbolName returns the name that node t uses, or
+   NULL if it uses none */
+static char *symbolName(Ast *ast, AstRef t) {
+    switch (astNodeKind(ast, t)) {
         case StmtK:
-            switch (t->kind.stmt) {
+            switch (astStmtKind(ast, t)) {
                 case AssignK:
                 case ReadK:
-                    if (st_lookup(t->attr.name) == -1)
-                        /* not yet in table, so treat as new definition */
-                        st_insert(t->attr.name, t->lineno, location++);
-                    else
-                        /* already in table, so ignore location,
-                           add line number of use only */
-                        st_insert(t->attr.name, t->lineno, 0);
-                    break;
+                    return astName(ast, t);
                 default:
-                    break;
+                    return NULL;
             }
-            break;
         case ExpK:
-            switch (t->kind.exp) {
-                case IdK:
-                    if (st_lookup(t->attr.name) == -1)
-                        /* not yet in table, so treat as new definition */
-                        st_insert(t->attr.name, t->lineno, location++);
-                    else
-                        /* already in table, so ignore location,
-                           add line number of use only */
-                        st_insert(t->attr.name, t->lineno, 0);
-                    break;
-                default:
-                    break;
-            }
-            break;
+            return astExpKind(ast, t) == IdK ? astName(ast, t) : NULL;
         default:
-            break;
+            return NULL;
     }
 }
 
-/* Function buildSymtab constructs the symbol
- * table by preorder traversal of the syntax tree
+/* Procedure enterSymbol enters the reference ref
+ * to the global name in the symbol table of ctx
  */
-void buildSymtab(TreeNode *syntaxTree) {
-    traverse(syntaxTree, insertNode, nullProc);
-    if (TraceAnalyze) {
-        fprintf(listing, "\nSymbol table:\n\n");
-        printSymTab(listing);
+void enterSymbol(Compiler *ctx, char *name, const XRef *ref) {
+    /* a name not yet in the table takes the next
+       location; one already there keeps its own */
+    int loc = st_find_or_insert(&ctx->symtab, name, ref, ctx->location);
+    if (loc == ctx->location)
+        ctx->location++;
+    else if (loc == -1)
+        outOfMemory(ctx);
+}
+
+/* SymbolWalk is the state of walkSymbols */
+typedef struct {
+    SymTab *st;
+    SymbolUse use;
+    void *arg;
+    AstRef callee; /* the name node of the last call met */
+    int ok;
+} SymbolWalk;
+
+/* declaredSize returns the frame locations that a
+   named expression node of kind k, with the n
+   dimensions dims, declares in the scope of a
+   function, or 0 if it declares nothing; a size
+   past INT_MAX is held at INT_MAX */
+static int declaredSize(ExpKind k, const int *dims, int n) {
+    long long size = 1;
+    switch (k) {
+        case ParamK:
+        case VarK:
+        case VarInK:
+            return 1;
+        case ArrK:
+        case ArrInK:
+            for (; n > 0 && size > 0 && size <= INT_MAX; n--)
+                size *= dims[n - 1];
+            return size > INT_MAX ? INT_MAX : size > 0 ? (int)size : 1;
+        default:
+            return 0;
     }
 }
 
-static void typeError(TreeNode *t, const char *message) {
-    fprintf(listing, "Type error at line %d: %s\n", t->lineno, message);
-    Error = TRUE;
+/* frameSize returns the frame locations that node
+   t declares in the scope of a function, or 0 if it
+   declares nothing */
+static int frameSize(Ast *ast, AstRef t) {
+    const int *dims;
+    int n;
+    if (astNodeKind(ast, t) != ExpK || astName(ast, t) == NULL) return 0;
+    n = astDims(ast, t, &dims);
+    return declaredSize(astExpKind(ast, t), dims, n);
 }
 
-/* Procedure checkNode performs
- * type checking at a single tree node
+/* Procedure insertNode opens the scope of a
+ * function, declares a parameter or local in it,
+ * or passes a reference to a global name on, for
+ * the SymbolWalk arg
+ */
+static void insertNode(Ast *ast, AstRef t, int depth, void *arg) {
+    SymbolWalk *w = arg;
+    char *name;
+    int size;
+    XRef ref;
+    (void)depth;
+    if (!w->ok) return;
+    if (astNodeKind(ast, t) == StmtK && astStmtKind(ast, t) == FuncK)
+        w->ok = st_enter_scope(w->st);
+    else if (w->st->depth > 0 && (size = frameSize(ast, t)) > 0)
+        w->ok = st_declare(w->st, astName(ast, t), size) != -1;
+    else if ((name = symbolName(ast, t)) != NULL &&
+             st_local(w->st, name) == -1) {
+        ref.lineno = astLineno(ast, t);
+        ref.column = astColumn(ast, t);
+        if (astNodeKind(ast, t) == StmtK)
+            ref.kind = DefR;
+        else
+            ref.kind = t == w->callee ? CallR : UseR;
+        w->use(name, &ref, w->arg);
+    } else if (astNodeKind(ast, t) == ExpK && astExpKind(ast, t) == FunCK)
+        /* its name node comes next, as its first child */
+        w->callee = astChild(ast, t, 0);
+}
+
+/* Procedure leaveNode closes the scope of a
+ * function for the SymbolWalk arg
+ */
+static void leaveNode(Ast *ast, AstRef t, int depth, void *arg) {
+    SymbolWalk *w = arg;
+    (void)depth;
+    if (w->ok && astNodeKind(ast, t) == StmtK && astStmtKind(ast, t) == FuncK)
+        st_exit_scope(w->st);
+}
+
+/* Function walkSymbols walks the tree t and its
+ * siblings in preorder, declaring the parameters
+ * and locals of each function in a scope of st
+ * opened for it, and calls use for each reference
+ * to a name declared in no open scope, a global; it
+ * returns FALSE when out of memory. The scopes of
+ * st are as they were when it returns
  */
-static void checkNode(TreeNode *t) {
-    switch (t->nodekind) {
+int walkSymbols(Ast *ast, AstRef t, SymTab *st, SymbolUse use, void *arg) {
+    SymbolWalk w;
+    int depth = st->depth;
+    w.st = st;
+    w.use = use;
+    w.arg = arg;
+    w.callee = 0;
+    w.ok = TRUE;
+    w.ok = astWalk(ast, t, insertNode, leaveNode, &w) && w.ok;
+    while (st->depth > depth) st_exit_scope(st);
+    return w.ok;
+}
+
+/* useGlobal enters a reference to a global name in
+   the symbol table of the compilation arg */
+static void useGlobal(char *name, const XRef *ref, void *arg) {
+    enterSymbol(arg, name, ref);
+}
+
+/* listSymtab lists the symbol table of ctx, when
+   tracing the analysis */
+static void listSymtab(Compiler *ctx) {
+    if (ctx->TraceAnalyze) {
+        outPrintf(&ctx->listing, "\nSymbol table:\n\n");
+        printSymTab(&ctx->symtab, &ctx->listing);
+    }
+}
+
+/* Function buildSymtab constructs the symbol
+ * table by preorder traversal of the syntax tree
+ */
+void buildSymtab(Compiler *ctx, Ast *syntaxTree) {
+    if (!walkSymbols(syntaxTree, syntaxTree->root, &ctx->symtab, useGlobal,
+                     ctx))
+        outOfMemory(ctx);
+    listSymtab(ctx);
+}
+
+/* typeRule applies the type rules at a node of the
+   kinds nk and k (with the operator op, for an OpK)
+   whose children 0 and 1 have the types t0 and t1
+   (Void for a missing one). It sets *type to the type
+   of the node, for a node that has one, and returns
+   the type error at the node, or NULL; *at is then
+   the child the error is reported at, or -1 for the
+   node itself */
+static const char *typeRule(NodeKind nk, int k, TokenType op, ExpType t0,
+                            ExpType t1, ExpType *type, int *at) {
+    *at = 0;
+    switch (nk) {
         case ExpK:
-            switch (t->kind.exp) {
+            switch (k) {
                 case OpK:
-                    if ((t->child[0]->type != Integer) ||
-                        (t->child[1]->type != Integer))
-                        typeError(t, "Op applied to non-integer");
-                    if ((t->attr.op == EQ) || (t->attr.op == LT))
-                        t->type = Boolean;
-                    else
-                        t->type = Integer;
-                    break;
+                    *type = (op == EQ) || (op == LT) ? Boolean : Integer;
+                    *at = -1;
+                    return (t0 != Integer) || (t1 != Integer)
+                               ? "Op applied to non-integer"
+                               : NULL;
                 case ConstK:
                 case IdK:
-                    t->type = Integer;
-                    break;
+                    *type = Integer;
+                    return NULL;
                 default:
-                    break;
+                    return NULL;
             }
-            break;
         case StmtK:
-            switch (t->kind.stmt) {
+            switch (k) {
                 case IfK:
-                    if (t->child[0]->type == Integer)
-                        typeError(t->child[0], "if test is not Boolean");
-                    break;
+                    return t0 == Integer ? "if test is not Boolean" : NULL;
                 case AssignK:
-                    if (t->child[0]->type != Integer)
-                        typeError(t->child[0],
-                                  "assignment of non-integer value");
-                    break;
+                    return t0 != Integer ? "assignment of non-integer value"
+                                         : NULL;
                 case WriteK:
-                    if (t->child[0]->type != Integer)
-                        typeError(t->child[0], "write of non-integer value");
-                    break;
+                    return t0 != Integer ? "write of non-integer value" : NULL;
                 case RepeatK:
-                    if (t->child[1]->type == Integer)
-                        typeError(t->child[1], "repeat test is not Boolean");
-                    break;
+                    *at = 1;
+                    return t1 == Integer ? "repeat test is not Boolean" : NULL;
                 default:
-                    break;
+                    return NULL;
             }
-            break;
         default:
-            break;
+            return NULL;
+    }
+}
+
+/* Procedure checkNode performs
+ * type checking at a single tree node
+ * for the compilation arg
+ */
+static void checkNode(Ast *ast, AstRef t, int depth, void *arg) {
+    Compiler *ctx = arg;
+    NodeKind nk = astNodeKind(ast, t);
+    int k = nk == StmtK ? (int)astStmtKind(ast, t) : (int)astExpKind(ast, t);
+    TokenType op = nk == ExpK && k == OpK ? astOp(ast, t) : ENDFILE;
+    ExpType type = astType(ast, t);
+    int at;
+    const char *error =
+        typeRule(nk, k, op, astType(ast, astChild(ast, t, 0)),
+                 astType(ast, astChild(ast, t, 1)), &type, &at);
+    (void)depth;
+    astSetType(ast, t, type);
+    if (error != NULL) {
+        outPrintf(&ctx->listing, "Type error at line %d: %s\n",
+                  astLineno(ast, at < 0 ? t : astChild(ast, t, at)), error);
+        ctx->Error = TRUE;
     }
 }
 
 /* Procedure typeCheck performs type checking
  * by a postorder syntax tree traversal
  */
-void typeCheck(TreeNode *syntaxTree) {
-    traverse(syntaxTree, nullProc, checkNode);
+void typeCheck(Compiler *ctx, Ast *syntaxTree) {
+    if (!astWalk(syntaxTree, syntaxTree->root, NULL, checkNode, ctx))
+        outOfMemory(ctx);
+}
+
+/* Procedure typeCheckNode type checks the tree t
+ * alone, not its siblings, as typeCheck does
+ */
+void typeCheckNode(Compiler *ctx, Ast *ast, AstRef t) {
+    if (!astWalkNode(ast, t, NULL, checkNode, ctx)) outOfMemory(ctx);
+}
+
+/* Procedure fuseScope opens the scope of a function
+ * the parser starts, or closes it (open FALSE) at
+ * the end of the function
+ */
+void fuseScope(Compiler *ctx, int open) {
+    if (ctx->fuseFailed) return;
+    if (!open)
+        st_exit_scope(&ctx->symtab);
+    else if (!st_enter_scope(&ctx->symtab))
+        ctx->fuseFailed = TRUE;
+}
+
+/* Procedure fuseDeclare declares the parameter or
+ * local t, once the parser has its dimensions, in
+ * the scope of the function around it, if any
+ */
+void fuseDeclare(Compiler *ctx, TreeNode *t) {
+    int size;
+    if (ctx->fuseFailed || ctx->symtab.depth == 0 || t->attr.name == NULL)
+        return;
+    size = declaredSize(t->kind.exp, t->attr.dem, t->attr.pos);
+    if (size > 0 && st_declare(&ctx->symtab, t->attr.name, size) == -1)
+        ctx->fuseFailed = TRUE;
+}
+
+/* Procedure fuseReference enters the reference of
+ * kind kind that node t makes to its name, unless
+ * a scope declares the name
+ */
+void fuseReference(Compiler *ctx, TreeNode *t, RefKind kind) {
+    XRef ref;
+    int loc;
+    if (ctx->fuseFailed || t->attr.name == NULL ||
+        (ctx->symtab.depth > 0 && st_local(&ctx->symtab, t->attr.name) != -1))
+        return;
+    ref.lineno = t->lineno;
+    ref.column = t->column;
+    ref.kind = kind;
+    /* as enterSymbol does, the error being listed
+       after the parse */
+    loc = st_find_or_insert(&ctx->symtab, t->attr.name, &ref, ctx->location);
+    if (loc == ctx->location)
+        ctx->location++;
+    else if (loc == -1)
+        ctx->fuseFailed = TRUE;
+}
+
+/* Procedure fuseCheck type checks the node t the
+ * parser has just finished, its children being
+ * checked already, keeping the error in the checks
+ * of ctx
+ */
+void fuseCheck(Compiler *ctx, TreeNode *t) {
+    TreeNode *c0 = t->child[0], *c1 = t->child[1];
+    int k = t->nodekind == StmtK ? (int)t->kind.stmt : (int)t->kind.exp;
+    int at;
+    const char *error = typeRule(t->nodekind, k, t->attr.op,
+                                 c0 ? c0->type : Void, c1 ? c1->type : Void,
+                                 &t->type, &at);
+    if (error != NULL) {
+        TreeNode *e = at < 0 ? t : t->child[at];
+        outPrintf(&ctx->checks, "Type error at line %d: %s\n",
+                  e ? e->lineno : 0, error);
+        ctx->checkError = TRUE;
+    }
+}
+
+/* Procedure buildSymtabFused finishes the symbol
+ * table the parser built, listing it as buildSymtab
+ * does
+ */
+void buildSymtabFused(Compiler *ctx) {
+    while (ctx->symtab.depth > 0) st_exit_scope(&ctx->symtab);
+    if (ctx->fuseFailed) outOfMemory(ctx);
+    listSymtab(ctx);
+}
+
+/* Procedure typeCheckFused lists the type errors
+ * the parser found, as typeCheck does
+ */
+void typeCheckFused(Compiler *ctx) {
+    outWrite(&ctx->listing, ctx->checks.text, ctx->checks.length);
+    if (ctx->checks.failed) outOfMemory(ctx);
+    if (ctx->checkError) ctx->Error = TRUE;
+    outRelease(&ctx->checks);
+    ctx->checkError = FALSE;
 }
@@ -7,16 +7,88 @@
 
 #ifndef _ANALYZE_H_
 #define _ANALYZE_H_
+#include "ast.h"
 #include "globals.h"
+#include "symtab.h"
 
 /* Function buildSymtab constructs the symbol
  * table by preorder traversal of the syntax tree
  */
-void buildSymtab(TreeNode *);
+void buildSymtab(Compiler *, Ast *);
+
+/* Procedure enterSymbol enters the reference ref
+ * to the global name in the symbol table of ctx
+ */
+void enterSymbol(Compiler *ctx, char *name, const XRef *ref);
+
+/* SymbolUse is called by walkSymbols for each
+ * reference ref to a global name
+ */
+typedef void (*SymbolUse)(char *name, const XRef *ref, void *arg);
+
+/* Function walkSymbols walks the tree t and its
+ * siblings in preorder, declaring the parameters
+ * and locals of each function in a scope of st
+ * opened for it, and calls use for each reference
+ * to a name declared in no open scope, a global; it
+ * returns FALSE when out of memory. The scopes of
+ * st are as they were when it returns
+ */
+int walkSymbols(Ast *ast, AstRef t, SymTab *st, SymbolUse use, void *arg);
 
 /* Procedure typeCheck performs type checking
  * by a postorder syntax tree traversal
  */
-void typeCheck(TreeNode *);
+void typeCheck(Compiler *, Ast *);
+
+/* Procedure typeCheckNode type checks the tree t
+ * alone, not its siblings, as typeCheck does
+ */
+void typeCheckNode(Compiler *ctx, Ast *ast, AstRef t);
+
+/* The semantic actions below are called by the
+ * parser as it builds the nodes, when fuseAnalysis
+ * is set in ctx: the program is then analyzed in
+ * the parse, in source order, which is the order
+ * of buildSymtab and of typeCheck. The results are
+ * put in the listing by buildSymtabFused and
+ * typeCheckFused, after a parse without errors
+ */
+
+/* Procedure fuseScope opens the scope of a function
+ * the parser starts, or closes it (open FALSE) at
+ * the end of the function
+ */
+void fuseScope(Compiler *ctx, int open);
+
+/* Procedure fuseDeclare declares the parameter or
+ * local t, once the parser has its dimensions, in
+ * the scope of the function around it, if any
+ */
+void fuseDeclare(Compiler *ctx, TreeNode *t);
+
+/* Procedure fuseReference enters the reference of
+ * kind kind that node t makes to its name, unless
+ * a scope declares the name
+ */
+void fuseReference(Compiler *ctx, TreeNode *t, RefKind kind);
+
+/* Procedure fuseCheck type checks the node t the
+ * parser has just finished, its children being
+ * checked already, keeping the error in the checks
+ * of ctx
+ */
+void fuseCheck(Compiler *ctx, TreeNode *t);
+
+/* Procedure buildSymtabFused finishes the symbol
+ * table the parser built, listing it as buildSymtab
+ * does
+ */
+void buildSymtabFused(Compiler *ctx);
+
+/* Procedure typeCheckFused lists the type errors
+ * the parser found, as typeCheck does
+ */
+void typeCheckFused(Compiler *ctx);
 
 #endif
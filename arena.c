@@ -0,0 +1,76 @@
+/****************************************************/
+/* File: arena.c                                    */
+/* Arena allocation of the syntax tree: nodes,      */
+/* attribute arrays and strings of one compilation  */
+/* Allocation bumps a pointer in the current block; */
+/* blocks are chained and only freed all together   */
+/****************************************************/
+
+#include "arena.h"
+
+/* size of an arena block; larger requests get a
+   block of their own */
+#define BLOCKSIZE (64 * 1024)
+
+/* alignment of every allocation */
+#define ALIGN 16
+
+typedef struct BlockRec {
+    struct BlockRec* next;
+    size_t size; /* bytes usable after the header */
+} Block;
+
+/* the header is padded to keep the data aligned */
+#define HEADER ((sizeof(Block) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+/* Function arenaAlloc returns size bytes from the
+ * arena, suitably aligned for any field of a tree
+ * node, or NULL when out of memory
+ */
+void* arenaAlloc(Arena* a, size_t size) {
+    char* p;
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    if (size > (size_t)(a->limit - a->next)) {
+        size_t n = size > BLOCKSIZE ? size : BLOCKSIZE;
+        Block* b = malloc(HEADER + n);
+        if (b == NULL) return NULL;
+        b->size = n;
+        if (n > BLOCKSIZE && a->blocks != NULL) {
+            /* a large request: keep the current block */
+            b->next = a->blocks->next;
+            a->blocks->next = b;
+            return (char*)b + HEADER;
+        }
+        b->next = a->blocks;
+        a->blocks = b;
+        a->next = (char*)b + HEADER;
+        a->limit = a->next + n;
+    }
+    p = a->next;
+    a->next += size;
+    return p;
+}
+
+/* Function arenaString copies s[0..len) into the
+ * arena as a null-terminated string
+ */
+char* arenaString(Arena* a, const char* s, int len) {
+    char* t = arenaAlloc(a, len + 1);
+    if (t != NULL) {
+        memcpy(t, s, len);
+        t[len] = '\0';
+    }
+    return t;
+}
+
+/* Procedure arenaRelease frees everything allocated
+ * in the arena at once
+ */
+void arenaRelease(Arena* a) {
+    Block* b;
+    while ((b = a->blocks) != NULL) {
+        a->blocks = b->next;
+        free(b);
+    }
+    a->next = a->limit = NULL;
+}
@@ -0,0 +1,36 @@
+/****************************************************/
+/* File: arena.h                                    */
+/* Arena allocation of the syntax tree: nodes,      */
+/* attribute arrays and strings of one compilation  */
+/****************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include "globals.h"
+
+/* Arena holds the blocks of one compilation; a
+ * zeroed Arena is empty
+ */
+typedef struct {
+    struct BlockRec* blocks; /* current block first */
+    char* next;              /* free space of the current block */
+    char* limit;
+} Arena;
+
+/* Function arenaAlloc returns size bytes from the
+ * arena, suitably aligned for any field of a tree
+ * node, or NULL when out of memory
+ */
+void* arenaAlloc(Arena* a, size_t size);
+
+/* Function arenaString copies s[0..len) into the
+ * arena as a null-terminated string
+ */
+char* arenaString(Arena* a, const char* s, int len);
+
+/* Procedure arenaRelease frees everything allocated
+ * in the arena at once
+ */
+void arenaRelease(Arena* a);
+
+#endif
@@ -0,0 +1,577 @@
+/****************************************************/
+/* File: ast.c                                      */
+/* Compact syntax tree: nodes in contiguous arrays, */
+/* linked by 32-bit indices, read through accessors */
+/* A node is a 20-byte header plus a payload of its */
+/* children and only the fields its kind uses       */
+/* As every link is an index, the arrays are saved  */
+/* to a file as they are and mapped back in place   */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ast.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "atom.h"
+
+/* the kind-specific fields of a node; DIMS, INITS and
+   SUBS take two words: start in extra and count */
+typedef enum {
+    F_OP,
+    F_VAL,
+    F_NAME,
+    F_TYPE,
+    F_DIMS,
+    F_INITS,
+    F_SUBS,
+    NFIELDS
+} Field;
+
+#define BIT(f) (1 << (f))
+#define WIDE (BIT(F_DIMS) | BIT(F_INITS) | BIT(F_SUBS))
+
+/* the fields of each kind of node, as read by the
+   passes over the tree */
+static const unsigned char stmtFields[16] = {
+    [AssignK] = BIT(F_NAME),
+    [ReadK] = BIT(F_NAME),
+    [FuncK] = BIT(F_NAME),
+    [TypeK] = BIT(F_TYPE),
+};
+
+static const unsigned char expFields[16] = {
+    [OpK] = BIT(F_OP),
+    [ConstK] = BIT(F_VAL),
+    [IdK] = BIT(F_NAME),
+    [ParamK] = BIT(F_NAME) | BIT(F_TYPE),
+    [VarK] = BIT(F_NAME),
+    [VarInK] = BIT(F_NAME) | BIT(F_TYPE) | BIT(F_VAL),
+    [ArrK] = BIT(F_NAME) | BIT(F_DIMS),
+    [ArrInK] = BIT(F_NAME) | BIT(F_DIMS) | BIT(F_INITS),
+    [ArrCK] = BIT(F_NAME) | BIT(F_SUBS),
+    [FunCK] = BIT(F_NAME),
+};
+
+/* fieldOffset gives the word of each field in the
+   payload after the children, -1 if absent;
+   fieldWords the size of all the fields */
+static signed char fieldOffset[2][16][NFIELDS];
+static unsigned char fieldWords[2][16];
+static pthread_once_t layoutOnce = PTHREAD_ONCE_INIT;
+
+static void initLayout(void) {
+    int nk, k, f, off, mask;
+    for (nk = 0; nk < 2; nk++)
+        for (k = 0; k < 16; k++) {
+            mask = nk == StmtK ? stmtFields[k] : expFields[k];
+            for (f = 0, off = 0; f < NFIELDS; f++)
+                if (mask & BIT(f)) {
+                    fieldOffset[nk][k][f] = off;
+                    off += (WIDE & BIT(f)) ? 2 : 1;
+                } else
+                    fieldOffset[nk][k][f] = -1;
+            fieldWords[nk][k] = off;
+        }
+}
+
+/* field returns the first word of field f of node n,
+   or NULL if its kind has no such field */
+static const int* field(const Ast* a, AstRef n, Field f) {
+    const AstNode* p = &a->nodes[n];
+    int off = fieldOffset[p->nodekind][p->kind][f];
+    return off < 0 ? NULL : &a->words[p->payload + p->nkids + off];
+}
+
+/* grow makes room for n more elements of the given
+   size in the array *p of *cap elements, *count used */
+static int grow(void* p, int* cap, int count, int n, size_t size) {
+    int c = *cap ? *cap : 256;
+    void* q;
+    while (c < count + n) c *= 2;
+    if (c == *cap) return TRUE;
+    q = realloc(*(void**)p, c * size);
+    if (q == NULL) return FALSE;
+    *(void**)p = q;
+    *cap = c;
+    return TRUE;
+}
+
+/* atomOrNone returns the atom id of s plus one, 0
+   for NULL, or -1 when out of memory */
+static int atomOrNone(Ast* a, const char* s) {
+    int id;
+    if (s == NULL) return 0;
+    id = intern(a->atoms, s, strlen(s));
+    return id < 0 ? -1 : id + 1;
+}
+
+/* addValues copies n values to the side table and
+   stores their start and count at w; it returns
+   FALSE when out of memory */
+static int addValues(Ast* a, int w, const int* v, int n) {
+    if (!grow(&a->extra, &a->extraCapacity, a->nextra, n, sizeof(int)))
+        return FALSE;
+    if (n > 0) memcpy(a->extra + a->nextra, v, n * sizeof(int));
+    a->words[w] = a->nextra;
+    a->words[w + 1] = n;
+    a->nextra += n;
+    return TRUE;
+}
+
+/* addNode enters the header and fields of t, the
+   children being left to the caller; it returns 0
+   when out of memory */
+static AstRef addNode(Ast* a, TreeNode* t) {
+    AstNode* p;
+    int nk = t->nodekind, k = nk == StmtK ? t->kind.stmt : t->kind.exp;
+    int nkids = MAXCHILDREN, w, off, i;
+    while (nkids > 0 && t->child[nkids - 1] == NULL) nkids--;
+    if (!grow(&a->nodes, &a->capacity, a->count, 1, sizeof(AstNode)) ||
+        !grow(&a->words, &a->wordCapacity, a->nwords,
+              nkids + fieldWords[nk][k], sizeof(int)))
+        return 0;
+    p = &a->nodes[a->count];
+    p->nodekind = (unsigned char)nk;
+    p->kind = (unsigned char)k;
+    p->type = (unsigned char)t->type;
+    p->nkids = (unsigned char)nkids;
+    p->lineno = t->lineno;
+    p->column = t->column;
+    p->sibling = 0;
+    p->payload = a->nwords;
+    w = a->nwords + nkids;
+    a->nwords += nkids + fieldWords[nk][k];
+    for (i = 0; i < nkids; i++) a->words[p->payload + i] = 0;
+    if ((off = fieldOffset[nk][k][F_OP]) >= 0) a->words[w + off] = t->attr.op;
+    if ((off = fieldOffset[nk][k][F_VAL]) >= 0) a->words[w + off] = t->attr.val;
+    if ((off = fieldOffset[nk][k][F_NAME]) >= 0 &&
+        (a->words[w + off] = atomOrNone(a, t->attr.name)) < 0)
+        return 0;
+    if ((off = fieldOffset[nk][k][F_TYPE]) >= 0 &&
+        (a->words[w + off] = atomOrNone(a, t->attr.type)) < 0)
+        return 0;
+    if ((off = fieldOffset[nk][k][F_DIMS]) >= 0 &&
+        !addValues(a, w + off, t->attr.dem, t->attr.pos))
+        return 0;
+    if ((off = fieldOffset[nk][k][F_INITS]) >= 0 &&
+        !addValues(a, w + off, t->attr.init_val, t->attr.ipos))
+        return 0;
+    if ((off = fieldOffset[nk][k][F_SUBS]) >= 0) {
+        if (!addValues(a, w + off, NULL, 0)) return 0;
+        for (i = 0; i < t->attr.ppos; i++) {
+            int id = intern(a->atoms, t->attr.invo[i], strlen(t->attr.invo[i]));
+            if (id < 0 ||
+                !grow(&a->extra, &a->extraCapacity, a->nextra, 1, sizeof(int)))
+                return 0;
+            a->extra[a->nextra++] = id;
+        }
+        a->words[w + off + 1] = t->attr.ppos;
+    }
+    return a->count++;
+}
+
+/* layout enters t and its siblings in preorder,
+   each node followed by the subtrees of its children,
+   and returns the index of t, or -1 when out of
+   memory */
+static AstRef layout(Ast* a, TreeNode* t) {
+    AstRef first = 0, prev = 0, n, c;
+    int i;
+    for (; t != NULL; t = t->sibling) {
+        if ((n = addNode(a, t)) == 0) return -1;
+        if (prev)
+            a->nodes[prev].sibling = n;
+        else
+            first = n;
+        for (i = 0; i < a->nodes[n].nkids; i++) {
+            if ((c = layout(a, t->child[i])) < 0) return -1;
+            a->words[a->nodes[n].payload + i] = c;
+        }
+        prev = n;
+    }
+    return first;
+}
+
+/* Function buildAst lays out the syntax tree t in a
+ * new Ast, interning its names and type names in
+ * atoms; it returns NULL when out of memory
+ */
+Ast* buildAst(AtomTable* atoms, TreeNode* t) {
+    Ast* a = calloc(1, sizeof(Ast));
+    if (a == NULL) return NULL;
+    pthread_once(&layoutOnce, initLayout);
+    a->atoms = atoms;
+    /* index 0 stands for no node: a header of zeros */
+    if (grow(&a->nodes, &a->capacity, 0, 1, sizeof(AstNode))) {
+        memset(&a->nodes[0], 0, sizeof(AstNode));
+        a->count = 1;
+        a->root = layout(a, t);
+    } else
+        a->root = -1;
+    if (a->root < 0) {
+        freeAst(a);
+        return NULL;
+    }
+    return a;
+}
+
+/* Procedure freeAst releases a */
+void freeAst(Ast* a) {
+    if (a == NULL) return;
+    if (a->image != NULL) {
+        munmap(a->image, a->imageSize);
+        free(a);
+        return;
+    }
+    free(a->nodes);
+    free(a->words);
+    free(a->extra);
+    free(a);
+}
+
+/* Procedure astMoveLines adds delta to the line
+ * number of every node of a
+ */
+void astMoveLines(Ast* a, int delta) {
+    int i;
+    for (i = 1; i < a->count; i++) a->nodes[i].lineno += delta;
+}
+
+/* the header of an image of a tree; each section
+   starts at an offset that is a multiple of 8, and
+   the names are atoms as the atom table stores them */
+typedef struct {
+    char magic[8];
+    int version;
+    int byteOrder; /* BYTEORDER, as written */
+    int nodeSize;  /* sizeof(AstNode) */
+    int root;
+    int count;
+    int nwords;
+    int nextra;
+    int natoms;
+    int nodesAt; /* count nodes */
+    int wordsAt; /* nwords payload words */
+    int extraAt; /* nextra side table values */
+    int namesAt; /* natoms offsets of the names */
+    int size;
+} Image;
+
+#define MAGIC "TINYAST"
+#define BYTEORDER 0x01020304
+
+/* section pads out to a multiple of 8 and writes the
+   n bytes at p there (zeros if p is NULL), returning
+   their offset */
+static int section(Output* out, const void* p, long n) {
+    static const char zeros[64];
+    int at;
+    outWrite(out, zeros, -out->length & 7);
+    at = out->length;
+    if (p != NULL)
+        outWrite(out, p, (int)n);
+    else
+        for (; n > 0; n -= sizeof(zeros))
+            outWrite(out, zeros, n < (long)sizeof(zeros) ? (int)n
+                                                         : (int)sizeof(zeros));
+    return at;
+}
+
+/* Function astSave writes a to the file name as an
+ * image that astMap can map back in; it returns
+ * FALSE when the file cannot be written
+ */
+int astSave(const Ast* a, const char* name) {
+    Output out = {0};
+    Image h;
+    FILE* f;
+    int i, ok;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(h.magic));
+    if (a->image != NULL) {
+        /* a mapped tree is its own image */
+        out.text = a->image;
+        out.length = (int)a->imageSize;
+    } else {
+        h.version = AST_VERSION;
+        h.byteOrder = BYTEORDER;
+        h.nodeSize = sizeof(AstNode);
+        h.root = a->root;
+        h.count = a->count;
+        h.nwords = a->nwords;
+        h.nextra = a->nextra;
+        h.natoms = atomCount(a->atoms);
+        section(&out, NULL, sizeof(h));
+        h.nodesAt = section(&out, a->nodes, (long)a->count * sizeof(AstNode));
+        h.wordsAt = section(&out, a->words, (long)a->nwords * sizeof(int));
+        h.extraAt = section(&out, a->extra, (long)a->nextra * sizeof(int));
+        h.namesAt = section(&out, NULL, (long)h.natoms * sizeof(int));
+        section(&out, NULL, 0);
+        for (i = 0; i < h.natoms && !out.failed; i++) {
+            int at = out.length + atomImage(a->atoms, i, &out);
+            if (!out.failed)
+                memcpy(out.text + h.namesAt + i * sizeof(int), &at,
+                       sizeof(int));
+        }
+        h.size = out.length;
+        if (out.failed) {
+            outRelease(&out);
+            return FALSE;
+        }
+        memcpy(out.text, &h, sizeof(h));
+    }
+    f = fopen(name, "wb");
+    ok = f != NULL && fwrite(out.text, 1, out.length, f) == (size_t)out.length;
+    if (f != NULL && fclose(f) != 0) ok = FALSE;
+    if (a->image == NULL) outRelease(&out);
+    return ok;
+}
+
+/* validImage checks the nodes and names of the image
+   whose header h has been checked: kinds in range,
+   links only forward in preorder (so no cycles),
+   payloads and side table spans in their sections,
+   and names NUL-terminated inside the image */
+static int validImage(const char* image, const Image* h) {
+    const AstNode* nodes = (const AstNode*)(image + h->nodesAt);
+    const int* words = (const int*)(image + h->wordsAt);
+    const int* nameAt = (const int*)(image + h->namesAt);
+    const int* w;
+    const AstNode* p;
+    int n, i, off;
+    for (n = 1; n < h->count; n++) {
+        p = &nodes[n];
+        if (p->nodekind > ExpK ||
+            p->kind > (p->nodekind == StmtK ? IdListK : FunCK) ||
+            p->type > Boolean || p->nkids > MAXCHILDREN ||
+            p->payload < 0 ||
+            p->payload + (long)p->nkids +
+                    fieldWords[p->nodekind][p->kind] > h->nwords ||
+            (p->sibling != 0 && (p->sibling <= n || p->sibling >= h->count)))
+            return FALSE;
+        w = words + p->payload;
+        for (i = 0; i < p->nkids; i++)
+            if (w[i] != 0 && (w[i] <= n || w[i] >= h->count)) return FALSE;
+        w += p->nkids;
+        for (i = F_NAME; i <= F_TYPE; i++)
+            if ((off = fieldOffset[p->nodekind][p->kind][i]) >= 0 &&
+                (w[off] < 0 || w[off] > h->natoms))
+                return FALSE;
+        for (i = F_DIMS; i <= F_SUBS; i++)
+            if ((off = fieldOffset[p->nodekind][p->kind][i]) >= 0 &&
+                (w[off] < 0 || w[off + 1] < 0 ||
+                 (long)w[off] + w[off + 1] > h->nextra))
+                return FALSE;
+        if ((off = fieldOffset[p->nodekind][p->kind][F_SUBS]) >= 0)
+            for (i = 0; i < w[off + 1]; i++) {
+                int id = ((const int*)(image + h->extraAt))[w[off] + i];
+                if (id < 0 || id >= h->natoms) return FALSE;
+            }
+    }
+    for (i = 0; i < h->natoms; i++)
+        if (nameAt[i] < h->namesAt || nameAt[i] >= h->size ||
+            memchr(image + nameAt[i], 0, h->size - nameAt[i]) == NULL)
+            return FALSE;
+    return TRUE;
+}
+
+/* Function astMap maps the image written by astSave
+ * to the file name and returns it as an Ast, read in
+ * place. Its header is checked, and then its nodes
+ * and names once, so that the tree can be walked
+ * without further checks. Setting types changes the
+ * mapping, not the file. It returns NULL when the
+ * file cannot be mapped or is not a valid image of
+ * this version
+ */
+Ast* astMap(const char* name) {
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    const Image* h;
+    char* image;
+    Ast* a;
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Image) ||
+        st.st_size > INT_MAX) {
+        close(fd);
+        return NULL;
+    }
+    /* private and writable, so that types can be set */
+    image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return NULL;
+    pthread_once(&layoutOnce, initLayout);
+    h = (const Image*)image;
+    if (memcmp(h->magic, MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != AST_VERSION || h->byteOrder != BYTEORDER ||
+        h->nodeSize != sizeof(AstNode) || h->size != st.st_size ||
+        h->count < 1 || h->root < 0 || h->root >= h->count ||
+        h->nwords < 0 || h->nextra < 0 || h->natoms < 0 ||
+        (h->nodesAt | h->wordsAt | h->extraAt | h->namesAt) & 7 ||
+        h->nodesAt < (int)sizeof(Image) ||
+        h->nodesAt + (long)h->count * h->nodeSize > h->wordsAt ||
+        h->wordsAt + (long)h->nwords * (int)sizeof(int) > h->extraAt ||
+        h->extraAt + (long)h->nextra * (int)sizeof(int) > h->namesAt ||
+        h->namesAt + (long)h->natoms * (int)sizeof(int) > h->size ||
+        !validImage(image, h) ||
+        (a = calloc(1, sizeof(Ast))) == NULL) {
+        munmap(image, st.st_size);
+        return NULL;
+    }
+    a->nodes = (AstNode*)(image + h->nodesAt);
+    a->count = h->count;
+    a->words = (int*)(image + h->wordsAt);
+    a->nwords = h->nwords;
+    a->extra = (int*)(image + h->extraAt);
+    a->nextra = h->nextra;
+    a->root = h->root;
+    a->image = image;
+    a->imageSize = st.st_size;
+    a->nameAt = (const int*)(image + h->namesAt);
+    return a;
+}
+
+/* Function astOp returns the operator of an OpK node */
+TokenType astOp(const Ast* a, AstRef n) {
+    const int* w = field(a, n, F_OP);
+    return w ? (TokenType)*w : ERROR;
+}
+
+/* Function astVal returns the value of a ConstK
+ * or VarInK node
+ */
+int astVal(const Ast* a, AstRef n) {
+    const int* w = field(a, n, F_VAL);
+    return w ? *w : 0;
+}
+
+/* Function astAtom returns the name of atom id, as
+ * found in the subscripts of a
+ */
+char* astAtom(const Ast* a, int id) {
+    return a->image ? a->image + a->nameAt[id] : atomName(a->atoms, id);
+}
+
+/* Function astName returns the (interned) name of
+ * a node, or NULL when it has none
+ */
+char* astName(const Ast* a, AstRef n) {
+    const int* w = field(a, n, F_NAME);
+    return w && *w ? astAtom(a, *w - 1) : NULL;
+}
+
+/* Function astTypeName returns the type name of a
+ * TypeK, ParamK or VarInK node, or NULL
+ */
+char* astTypeName(const Ast* a, AstRef n) {
+    const int* w = field(a, n, F_TYPE);
+    return w && *w ? astAtom(a, *w - 1) : NULL;
+}
+
+/* values returns the count of the side table values
+   of field f of n, setting *v to them */
+static int values(const Ast* a, AstRef n, Field f, const int** v) {
+    const int* w = field(a, n, f);
+    if (w == NULL) {
+        *v = NULL;
+        return 0;
+    }
+    *v = a->extra + w[0];
+    return w[1];
+}
+
+/* Function astDims returns the number of dimensions
+ * of an ArrK or ArrInK node, setting *dims to them
+ */
+int astDims(const Ast* a, AstRef n, const int** dims) {
+    return values(a, n, F_DIMS, dims);
+}
+
+/* Function astInits returns the number of initial
+ * values of an ArrInK node, setting *vals to them
+ */
+int astInits(const Ast* a, AstRef n, const int** vals) {
+    return values(a, n, F_INITS, vals);
+}
+
+/* Function astSubscripts returns the number of
+ * subscripts of an ArrCK node, setting *atoms to
+ * their atom ids
+ */
+int astSubscripts(const Ast* a, AstRef n, const int** atoms) {
+    return values(a, n, F_SUBS, atoms);
+}
+
+/* walk visits the tree t, and its siblings if
+   siblings, as astWalk does */
+static int walk(Ast* a, AstRef t, int siblings, AstVisit pre, AstVisit post,
+                void* arg) {
+    /* the node being visited at each level, with the
+       child to visit next; a finished node is replaced
+       by its sibling */
+    struct {
+        AstRef node;
+        int next;
+    }* stack;
+    int top = 0, capacity = 64;
+    if (t == 0) return TRUE;
+    stack = malloc(capacity * sizeof(*stack));
+    if (stack == NULL) return FALSE;
+    stack[0].node = t;
+    stack[0].next = 0;
+    if (pre) pre(a, t, 0, arg);
+    while (top >= 0) {
+        AstRef n = stack[top].node, c;
+        if (stack[top].next < a->nodes[n].nkids) {
+            c = a->words[a->nodes[n].payload + stack[top].next++];
+            if (c == 0) continue;
+            if (++top == capacity) {
+                void* q = realloc(stack, 2 * capacity * sizeof(*stack));
+                if (q == NULL) {
+                    free(stack);
+                    return FALSE;
+                }
+                stack = q;
+                capacity *= 2;
+            }
+            stack[top].node = c;
+            stack[top].next = 0;
+            if (pre) pre(a, c, top, arg);
+        } else {
+            if (post) post(a, n, top, arg);
+            if ((top > 0 || siblings) && (c = astSibling(a, n)) != 0) {
+                stack[top].node = c;
+                stack[top].next = 0;
+                if (pre) pre(a, c, top, arg);
+            } else
+                top--;
+        }
+    }
+    free(stack);
+    return TRUE;
+}
+
+/* Function astWalk visits the tree t and its
+ * siblings, calling pre (if not NULL) before the
+ * children of each node and post (if not NULL) after
+ * them; it keeps its stack on the heap, one entry per
+ * level of nesting, and returns FALSE when out of
+ * memory
+ */
+int astWalk(Ast* a, AstRef t, AstVisit pre, AstVisit post, void* arg) {
+    return walk(a, t, TRUE, pre, post, arg);
+}
+
+/* Function astWalkNode visits the tree t as astWalk
+ * does, but not its siblings
+ */
+int astWalkNode(Ast* a, AstRef t, AstVisit pre, AstVisit post, void* arg) {
+    return walk(a, t, FALSE, pre, post, arg);
+}
@@ -0,0 +1,165 @@
+/****************************************************/
+/* File: ast.h                                      */
+/* Compact syntax tree: nodes in contiguous arrays, */
+/* linked by 32-bit indices, read through accessors */
+/****************************************************/
+
+#ifndef _AST_H_
+#define _AST_H_
+#include "atom.h"
+#include "globals.h"
+
+/* AstRef is the index of a node; 0 stands for none */
+typedef int AstRef;
+
+/* AstNode is the fixed header of every node; its
+ * children and kind-specific fields are words of
+ * the payload, which starts at words[payload]:
+ * first the nkids children, then the fields the
+ * kind uses (see ast.c)
+ */
+typedef struct {
+    unsigned char nodekind; /* NodeKind */
+    unsigned char kind;     /* StmtKind or ExpKind */
+    unsigned char type;     /* ExpType, for type checking */
+    unsigned char nkids;    /* children up to the last one present */
+    int lineno;
+    int column; /* of its name, or of its first token */
+    AstRef sibling;
+    int payload;
+} AstNode;
+
+/* Ast holds a whole syntax tree in preorder; the
+ * dimensions, initial values and subscripts of
+ * arrays are kept in the side table extra. A tree
+ * mapped from a file by astMap has its arrays and
+ * names in the mapping, image, and no atom table
+ */
+typedef struct {
+    AstNode* nodes; /* nodes[0] is unused */
+    int count;
+    int capacity;
+    int* words; /* payloads */
+    int nwords;
+    int wordCapacity;
+    int* extra; /* side table of array values */
+    int nextra;
+    int extraCapacity;
+    AtomTable* atoms; /* the table of the names */
+    AstRef root;
+    char* image; /* the mapped file, or NULL */
+    long imageSize;
+    const int* nameAt; /* offsets in image of the names */
+} Ast;
+
+/* AST_VERSION is the version of the file format of
+ * astSave; it changes whenever the layout of the
+ * nodes or of the fields of a kind does
+ */
+#define AST_VERSION 2
+
+/* accessors of the node header */
+#define astNodeKind(a, n) ((NodeKind)(a)->nodes[n].nodekind)
+#define astStmtKind(a, n) ((StmtKind)(a)->nodes[n].kind)
+#define astExpKind(a, n) ((ExpKind)(a)->nodes[n].kind)
+#define astLineno(a, n) ((a)->nodes[n].lineno)
+#define astColumn(a, n) ((a)->nodes[n].column)
+#define astSibling(a, n) ((a)->nodes[n].sibling)
+#define astType(a, n) ((ExpType)(a)->nodes[n].type)
+#define astSetType(a, n, t) ((a)->nodes[n].type = (unsigned char)(t))
+#define astChild(a, n, i) \
+    ((i) < (a)->nodes[n].nkids ? (a)->words[(a)->nodes[n].payload + (i)] : 0)
+
+/* Function buildAst lays out the syntax tree t in a
+ * new Ast, interning its names and type names in
+ * atoms; it returns NULL when out of memory
+ */
+Ast* buildAst(AtomTable* atoms, TreeNode* t);
+
+/* Procedure freeAst releases a */
+void freeAst(Ast* a);
+
+/* Procedure astMoveLines adds delta to the line
+ * number of every node of a
+ */
+void astMoveLines(Ast* a, int delta);
+
+/* Function astSave writes a to the file name as an
+ * image that astMap can map back in; it returns
+ * FALSE when the file cannot be written
+ */
+int astSave(const Ast* a, const char* name);
+
+/* Function astMap maps the image written by astSave
+ * to the file name and returns it as an Ast, read in
+ * place. Its header is checked, and then its nodes
+ * and names once, so that the tree can be walked
+ * without further checks. Setting types changes the
+ * mapping, not the file. It returns NULL when the
+ * file cannot be mapped or is not a valid image of
+ * this version
+ */
+Ast* astMap(const char* name);
+
+/* accessors of the kind-specific fields, in the
+ * nodes whose kind has them */
+
+/* Function astOp returns the operator of an OpK node */
+TokenType astOp(const Ast* a, AstRef n);
+
+/* Function astVal returns the value of a ConstK
+ * or VarInK node
+ */
+int astVal(const Ast* a, AstRef n);
+
+/* Function astName returns the (interned) name of
+ * a node, or NULL when it has none
+ */
+char* astName(const Ast* a, AstRef n);
+
+/* Function astTypeName returns the type name of a
+ * TypeK, ParamK or VarInK node, or NULL
+ */
+char* astTypeName(const Ast* a, AstRef n);
+
+/* Function astDims returns the number of dimensions
+ * of an ArrK or ArrInK node, setting *dims to them
+ */
+int astDims(const Ast* a, AstRef n, const int** dims);
+
+/* Function astInits returns the number of initial
+ * values of an ArrInK node, setting *vals to them
+ */
+int astInits(const Ast* a, AstRef n, const int** vals);
+
+/* Function astSubscripts returns the number of
+ * subscripts of an ArrCK node, setting *atoms to
+ * their atom ids
+ */
+int astSubscripts(const Ast* a, AstRef n, const int** atoms);
+
+/* Function astAtom returns the name of atom id, as
+ * found in the subscripts of a
+ */
+char* astAtom(const Ast* a, int id);
+
+/* AstVisit is called by astWalk at node n, depth
+ * being the number of nodes n is nested in
+ */
+typedef void (*AstVisit)(Ast* a, AstRef n, int depth, void* arg);
+
+/* Function astWalk visits the tree t and its
+ * siblings, calling pre (if not NULL) before the
+ * children of each node and post (if not NULL) after
+ * them; it keeps its stack on the heap, one entry per
+ * level of nesting, and returns FALSE when out of
+ * memory
+ */
+int astWalk(Ast* a, AstRef t, AstVisit pre, AstVisit post, void* arg);
+
+/* Function astWalkNode visits the tree t as astWalk
+ * does, but not its siblings
+ */
+int astWalkNode(Ast* a, AstRef t, AstVisit pre, AstVisit post, void* arg);
+
+#endif
@@ -0,0 +1,124 @@
+/****************************************************/
+/* File: atom.c                                     */
+/* Identifier interning (atom table) shared by the  */
+/* scanner, the parser and the symbol table         */
+/* The table is open-addressed with linear probing  */
+/* and doubles when half full                       */
+/****************************************************/
+
+#include "atom.h"
+
+#include <stddef.h>
+
+/* each interned name is stored once, right after
+   its hash and id, so atomHash can find them from
+   the name pointer alone */
+typedef struct AtomRec {
+    unsigned hash;
+    int id;
+    int len;
+    char name[];
+} Atom;
+
+#define atomOf(s) ((Atom*)((s)-offsetof(Atom, name)))
+
+/* the hash function: 32-bit FNV-1a */
+static unsigned hashName(const char* s, int len) {
+    unsigned h = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* growTable doubles the table and re-enters the
+   atoms, using their stored hashes */
+static int growTable(AtomTable* t) {
+    int size = t->tableSize ? 2 * t->tableSize : 1024;
+    Atom** table = calloc(size, sizeof(Atom*));
+    int i, h;
+    if (table == NULL) return FALSE;
+    for (i = 0; i < t->nAtoms; i++) {
+        h = t->byId[i]->hash & (size - 1);
+        while (table[h] != NULL) h = (h + 1) & (size - 1);
+        table[h] = t->byId[i];
+    }
+    free(t->table);
+    t->table = table;
+    t->tableSize = size;
+    return TRUE;
+}
+
+/* Function intern returns the atom id of the name
+ * s[0..len), entering the name in the atom table
+ * the first time it is seen, or -1 when out of
+ * memory
+ */
+int intern(AtomTable* t, const char* s, int len) {
+    unsigned hash = hashName(s, len);
+    Atom* a;
+    int h;
+    if (2 * (t->nAtoms + 1) > t->tableSize && !growTable(t)) return -1;
+    h = hash & (t->tableSize - 1);
+    while ((a = t->table[h]) != NULL) {
+        if (a->hash == hash && a->len == len && !memcmp(a->name, s, len))
+            return a->id;
+        h = (h + 1) & (t->tableSize - 1);
+    }
+    if (t->nAtoms == t->byIdSize) {
+        int size = t->byIdSize ? 2 * t->byIdSize : 1024;
+        Atom** b = realloc(t->byId, size * sizeof(Atom*));
+        if (b == NULL) return -1;
+        t->byId = b;
+        t->byIdSize = size;
+    }
+    a = malloc(sizeof(Atom) + len + 1);
+    if (a == NULL) return -1;
+    a->hash = hash;
+    a->id = t->nAtoms;
+    a->len = len;
+    memcpy(a->name, s, len);
+    a->name[len] = '\0';
+    t->table[h] = a;
+    t->byId[t->nAtoms++] = a;
+    return a->id;
+}
+
+/* Function atomName returns the unique stored copy
+ * of the name of an atom
+ */
+char* atomName(const AtomTable* t, int id) { return t->byId[id]->name; }
+
+/* Function atomHash returns the hash of an interned
+ * name, computed only once when it was entered
+ */
+unsigned atomHash(const char* name) { return atomOf(name)->hash; }
+
+/* Function atomCount returns the number of atoms */
+int atomCount(const AtomTable* t) { return t->nAtoms; }
+
+/* Function atomImage appends atom id to out as it
+ * is stored, padded to a multiple of 4 bytes, and
+ * returns the offset of its name in what it wrote
+ */
+int atomImage(const AtomTable* t, int id, Output* out) {
+    static const char zeros[sizeof(Atom)];
+    Atom* a = t->byId[id];
+    int size = (int)offsetof(Atom, name) + a->len + 1;
+    outWrite(out, (const char*)a, size);
+    outWrite(out, zeros, -size & 3);
+    return (int)offsetof(Atom, name);
+}
+
+/* Procedure freeAtoms empties the atom table and
+ * releases every interned name
+ */
+void freeAtoms(AtomTable* t) {
+    int i;
+    for (i = 0; i < t->nAtoms; i++) free(t->byId[i]);
+    free(t->byId);
+    free(t->table);
+    memset(t, 0, sizeof(*t));
+}
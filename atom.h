@@ -0,0 +1,58 @@
+/****************************************************/
+/* File: atom.h                                     */
+/* Identifier interning (atom table) shared by the  */
+/* scanner, the parser and the symbol table         */
+/****************************************************/
+
+#ifndef _ATOM_H_
+#define _ATOM_H_
+#include "globals.h"
+#include "output.h"
+
+/* AtomTable holds the names interned by one
+ * compilation; a zeroed AtomTable is empty
+ */
+typedef struct {
+    struct AtomRec** table; /* open-addressed, size is a power of 2 */
+    int tableSize;
+    struct AtomRec** byId; /* atoms in order of entry */
+    int nAtoms;
+    int byIdSize;
+} AtomTable;
+
+/* Function intern returns the atom id of the name
+ * s[0..len), entering the name in the atom table
+ * the first time it is seen, or -1 when out of
+ * memory
+ */
+int intern(AtomTable* t, const char* s, int len);
+
+/* Function atomName returns the unique stored copy
+ * of the name of an atom: equal names always give
+ * the same pointer, so names are compared by identity
+ */
+char* atomName(const AtomTable* t, int id);
+
+/* Function atomHash returns the hash of an interned
+ * name (as returned by atomName), computed only once
+ * when the name was entered
+ */
+unsigned atomHash(const char* name);
+
+/* Function atomCount returns the number of atoms */
+int atomCount(const AtomTable* t);
+
+/* Function atomImage appends atom id to out as it
+ * is stored, padded to a multiple of 4 bytes, and
+ * returns the offset of its name in what it wrote:
+ * a copy read back at an address aligned to 4 is
+ * an interned name that atomHash can be used on
+ */
+int atomImage(const AtomTable* t, int id, Output* out);
+
+/* Procedure freeAtoms empties the atom table and
+ * releases every interned name
+ */
+void freeAtoms(AtomTable* t);
+
+#endif
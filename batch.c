@@ -0,0 +1,263 @@
+/****************************************************/
+/* File: batch.c                                    */
+/* Batch compilation of many TINY source files on   */
+/* a work-stealing pool of threads                  */
+/* Each thread owns a range of the files and works  */
+/* through it from the front; a thread whose range  */
+/* is used up steals the back half of the range of  */
+/* another thread                                   */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "util.h"
+
+/* outcome of the compilation of one file */
+typedef enum { JOB_OK, JOB_ERRORS, JOB_NOFILE, JOB_NOMEMORY } Outcome;
+
+typedef struct {
+    const char* name;
+    Outcome outcome;
+    double seconds;
+} Job;
+
+/* Range is the part of the jobs owned by a thread:
+   jobs[next..end) */
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} Range;
+
+/* Batch is the state of one batch compilation,
+   shared by its threads */
+typedef struct {
+    Job* jobs;
+    Range* ranges;
+    int nthreads;
+    const TinyOptions* options;
+    Cache* cache; /* or NULL */
+} Batch;
+
+/* Worker is one thread of the batch */
+typedef struct {
+    Batch* batch;
+    int id;
+} Worker;
+
+/* writeFile writes the length bytes of text to the
+   file name with its extension replaced by ext */
+static void writeFile(const char* name, const char* ext, const char* text,
+                      int length) {
+    char* out = outputName(name, ext);
+    FILE* f = out ? fopen(out, "w") : NULL;
+    if (f == NULL)
+        fprintf(stderr, "Unable to open %s\n", out ? out : name);
+    else {
+        fwrite(text, 1, length, f);
+        fclose(f);
+    }
+    free(out);
+}
+
+/* compileJob compiles the file of job j in a
+   compilation of its own */
+static void compileJob(Batch* b, Job* j) {
+    TinyOptions opt = *b->options;
+    TinyResult result;
+    double t0 = now();
+    int length;
+    char* text = readFile(j->name, &length);
+    if (text == NULL) {
+        j->outcome = JOB_NOFILE;
+        return;
+    }
+    opt.name = j->name;
+    opt.threads = 1;
+    if (!(b->cache ? cacheCompile(b->cache, text, length, &opt, &result)
+                   : tinyCompile(text, length, &opt, &result)))
+        j->outcome = JOB_NOMEMORY;
+    else
+        j->outcome = result.Error ? JOB_ERRORS : JOB_OK;
+    if (result.listing != NULL)
+        writeFile(j->name, ".lst", result.listing, result.listingLength);
+    if (result.code != NULL)
+        writeFile(j->name, ".tm", result.code, result.codeLength);
+    tinyFree(&result);
+    free(text);
+    j->seconds = now() - t0;
+}
+
+/* takeJob takes the next job of thread id, stealing
+   the back half of the range of another thread when
+   its own is used up; it returns -1 when no job is
+   left anywhere */
+static int takeJob(Batch* b, int id) {
+    Range* own = &b->ranges[id];
+    int job = -1, i;
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) job = own->next++;
+    pthread_mutex_unlock(&own->lock);
+    for (i = 1; job < 0 && i < b->nthreads; i++) {
+        Range* victim = &b->ranges[(id + i) % b->nthreads];
+        int from = 0, to = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            to = victim->end;
+            from = victim->end -= (victim->end - victim->next + 1) / 2;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (from < to) {
+            pthread_mutex_lock(&own->lock);
+            own->next = from + 1;
+            own->end = to;
+            pthread_mutex_unlock(&own->lock);
+            job = from;
+        }
+    }
+    return job;
+}
+
+/* runWorker is run by each thread of the batch */
+static void* runWorker(void* arg) {
+    Worker* w = arg;
+    int job;
+    while ((job = takeJob(w->batch, w->id)) >= 0)
+        compileJob(w->batch, &w->batch->jobs[job]);
+    return NULL;
+}
+
+/* printSummary prints the time and outcome of every
+   job, in the order given, and the totals */
+static void printSummary(Batch* b, int count, double wall) {
+    static const char* outcomes[] = {"ok", "errors", "not found",
+                                     "out of memory"};
+    int n[JOB_NOMEMORY + 1] = {0}, i;
+    double total = 0;
+    printf("\n%-40s %10s  %s\n", "File", "Time (ms)", "Result");
+    for (i = 0; i < count; i++) {
+        Job* j = &b->jobs[i];
+        printf("%-40s %10.3f  %s\n", j->name, j->seconds * 1e3,
+               outcomes[j->outcome]);
+        total += j->seconds;
+        n[j->outcome]++;
+    }
+    printf("\n%d files: %d ok, %d with errors, %d not compiled\n", count,
+           n[JOB_OK], n[JOB_ERRORS], n[JOB_NOFILE] + n[JOB_NOMEMORY]);
+    printf("%.3f ms compiling, %.3f ms wall on %d threads\n", total * 1e3,
+           wall * 1e3, b->nthreads);
+    if (b->cache != NULL)
+        printf("cache: %ld hits, %ld misses, %ld evictions\n",
+               b->cache->hits, b->cache->misses, b->cache->evictions);
+}
+
+/* Function batchAdd appends to *names (of *count
+ * entries) a copy of the length bytes of name; it
+ * returns FALSE when out of memory
+ */
+int batchAdd(char*** names, int* count, const char* name, int length) {
+    char** grown = realloc(*names, (*count + 1) * sizeof(char*));
+    char* copy;
+    if (grown == NULL) return FALSE;
+    *names = grown;
+    if ((copy = malloc(length + 1)) == NULL) return FALSE;
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    (*names)[(*count)++] = copy;
+    return TRUE;
+}
+
+/* Function readManifest appends to *names (of *count
+ * entries, growing it as needed) the file names
+ * listed one per line in the manifest file; blank
+ * lines are skipped and trailing blanks dropped.
+ * It returns FALSE when the manifest cannot be
+ * read or memory runs out
+ */
+int readManifest(const char* manifest, char*** names, int* count) {
+    int length, start, end, n;
+    char* text = readFile(manifest, &length);
+    if (text == NULL) return FALSE;
+    for (start = 0; start < length; start = end + 1) {
+        const char* eol = memchr(text + start, '\n', length - start);
+        end = eol ? (int)(eol - text) : length;
+        n = end - start;
+        while (n > 0 && isspace((unsigned char)text[start + n - 1])) n--;
+        if (n == 0) continue;
+        if (!batchAdd(names, count, text + start, n)) {
+            free(text);
+            return FALSE;
+        }
+    }
+    free(text);
+    return TRUE;
+}
+
+/* Function compileBatch compiles each of the count
+ * files with options on nthreads threads (0: one
+ * per processor), every file in a compilation of
+ * its own. The listing of a file x.tny goes to
+ * x.lst and its code to x.tm, whatever the order
+ * the files are compiled in; a summary of the
+ * time and outcome of each file is then printed to
+ * stdout in the order given. The results are taken
+ * from cache, if not NULL, when they are there. It
+ * returns the number of files that did not compile
+ * without errors
+ */
+int compileBatch(char** names, int count, const TinyOptions* options,
+                 int nthreads, Cache* cache) {
+    Batch b;
+    Worker* workers;
+    pthread_t* threads;
+    int started = 0, failed = 0, i;
+    double t0 = now();
+    if (nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > count) nthreads = count > 0 ? count : 1;
+    b.jobs = calloc(count > 0 ? count : 1, sizeof(Job));
+    b.ranges = calloc(nthreads, sizeof(Range));
+    workers = calloc(nthreads, sizeof(Worker));
+    threads = calloc(nthreads, sizeof(pthread_t));
+    if (!b.jobs || !b.ranges || !workers || !threads) {
+        fprintf(stderr, "Out of memory error in batch\n");
+        free(b.jobs);
+        free(b.ranges);
+        free(workers);
+        free(threads);
+        return count;
+    }
+    b.nthreads = nthreads;
+    b.options = options;
+    b.cache = cache;
+    for (i = 0; i < count; i++) b.jobs[i].name = names[i];
+    /* each thread starts with an even share of the
+       files, in order */
+    for (i = 0; i < nthreads; i++) {
+        pthread_mutex_init(&b.ranges[i].lock, NULL);
+        b.ranges[i].next = (int)((long long)count * i / nthreads);
+        b.ranges[i].end = (int)((long long)count * (i + 1) / nthreads);
+        workers[i].batch = &b;
+        workers[i].id = i;
+    }
+    while (started < nthreads - 1 &&
+           pthread_create(&threads[started], NULL, runWorker,
+                          &workers[started + 1]) == 0)
+        started++;
+    runWorker(&workers[0]);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    printSummary(&b, count, now() - t0);
+    for (i = 0; i < count; i++)
+        if (b.jobs[i].outcome != JOB_OK) failed++;
+    for (i = 0; i < nthreads; i++) pthread_mutex_destroy(&b.ranges[i].lock);
+    free(b.jobs);
+    free(b.ranges);
+    free(workers);
+    free(threads);
+    return failed;
+}
@@ -0,0 +1,42 @@
+/****************************************************/
+/* File: batch.h                                    */
+/* Batch compilation of many TINY source files on   */
+/* a work-stealing pool of threads                  */
+/****************************************************/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+#include "cache.h"
+#include "tiny.h"
+
+/* Function batchAdd appends to *names (of *count
+ * entries) a copy of the length bytes of name; it
+ * returns FALSE when out of memory
+ */
+int batchAdd(char*** names, int* count, const char* name, int length);
+
+/* Function readManifest appends to *names (of *count
+ * entries, growing it as needed) the file names
+ * listed one per line in the manifest file; blank
+ * lines are skipped and trailing blanks dropped.
+ * It returns FALSE when the manifest cannot be
+ * read or memory runs out
+ */
+int readManifest(const char* manifest, char*** names, int* count);
+
+/* Function compileBatch compiles each of the count
+ * files with options on nthreads threads (0: one
+ * per processor), every file in a compilation of
+ * its own. The listing of a file x.tny goes to
+ * x.lst and its code to x.tm, whatever the order
+ * the files are compiled in; a summary of the
+ * time and outcome of each file is then printed to
+ * stdout in the order given. The results are taken
+ * from cache, if not NULL, when they are there. It
+ * returns the number of files that did not compile
+ * without errors
+ */
+int compileBatch(char** names, int count, const TinyOptions* options,
+                 int nthreads, Cache* cache);
+
+#endif
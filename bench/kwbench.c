@@ -0,0 +1,127 @@
+/****************************************************/
+/* File: kwbench.c                                  */
+/* Microbenchmark of reserved word recognition:     */
+/* the perfect-hash reservedLookup of scan.c        */
+/* against the original linear strcmp search        */
+/*                                                  */
+/* build: gcc -O2 -std=c99 bench/kwbench.c util.c   */
+/*        skip.c atom.c arena.c ast.c output.c      */
+/*        -o kwbench -pthread                       */
+/* run:   ./kwbench [file.tny] [rounds]             */
+/****************************************************/
+
+/* scan.c is included so its static lookup can be timed */
+#include "../scan.c"
+
+/* the reserved word table and lookup as they were
+   before the perfect hash */
+static struct {
+    char* str;
+    TokenType tok;
+} linearWords[MAXRESERVED] = {{"if", IF},         {"then", THEN},
+                              {"else", ELSE},     {"end", END},
+                              {"repeat", REPEAT}, {"until", UNTIL},
+                              {"read", READ},     {"write", WRITE},
+                              {"int", INT},       {"function", FUNCTION},
+                              {"while", WHILE},   {"do", DO},
+                              {"return", RETURN}};
+
+static TokenType linearLookup(char* s) {
+    int i;
+    for (i = 0; i < MAXRESERVED; i++)
+        if (!strcmp(s, linearWords[i].str)) return linearWords[i].tok;
+    return ID;
+}
+
+/* the corpus: NUL-terminated words packed in one buffer */
+#define MAXWORDS 1000000
+static char* words[MAXWORDS];
+static int lens[MAXWORDS];
+static int nwords = 0;
+
+static void addWord(const char* s, int len) {
+    char* w;
+    if (nwords == MAXWORDS || len > MAXTOKENLEN) return;
+    w = malloc(len + 1);
+    memcpy(w, s, len);
+    w[len] = '\0';
+    words[nwords] = w;
+    lens[nwords++] = len;
+}
+
+/* corpusFromFile collects every identifier-like run
+   of letters in a TINY source file */
+static void corpusFromFile(const char* name) {
+    FILE* f = fopen(name, "r");
+    int c, len = 0;
+    char buf[MAXTOKENLEN + 1];
+    if (f == NULL) {
+        fprintf(stderr, "File %s not found\n", name);
+        exit(1);
+    }
+    while ((c = fgetc(f)) != EOF) {
+        if (isalpha(c)) {
+            if (len < MAXTOKENLEN) buf[len] = (char)c;
+            len++;
+        } else if (len > 0) {
+            addWord(buf, len < MAXTOKENLEN ? len : MAXTOKENLEN);
+            len = 0;
+        }
+    }
+    fclose(f);
+}
+
+/* syntheticCorpus builds identifiers of typical lengths
+   with one keyword in eight, as in generated programs */
+static void syntheticCorpus(int n) {
+    char buf[16];
+    int i, j, len;
+    srand(1);
+    for (i = 0; i < n; i++) {
+        if (rand() % 8 == 0) {
+            char* kw = linearWords[rand() % MAXRESERVED].str;
+            addWord(kw, strlen(kw));
+            continue;
+        }
+        len = 1 + rand() % 10;
+        for (j = 0; j < len; j++)
+            buf[j] = "abcdefghijklmnoprstuwxyz"[rand() % 24];
+        addWord(buf, len);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 2 ? atoi(argv[2]) : 50;
+    int r, i;
+    long sumLinear = 0, sumHash = 0;
+    double t0, tLinear, tHash;
+    if (argc > 1)
+        corpusFromFile(argv[1]);
+    else
+        syntheticCorpus(MAXWORDS);
+    if (nwords == 0) {
+        fprintf(stderr, "empty corpus\n");
+        return 1;
+    }
+    for (i = 0; i < nwords; i++)
+        if (linearLookup(words[i]) != reservedLookup(words[i], lens[i])) {
+            fprintf(stderr, "mismatch on \"%s\"\n", words[i]);
+            return 1;
+        }
+    t0 = now();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < nwords; i++) sumLinear += linearLookup(words[i]);
+    tLinear = now() - t0;
+    t0 = now();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < nwords; i++)
+            sumHash += reservedLookup(words[i], lens[i]);
+    tHash = now() - t0;
+    printf("%d identifiers x %d rounds\n", nwords, rounds);
+    printf("linear strcmp: %8.2f ns/lookup\n",
+           tLinear * 1e9 / ((double)nwords * rounds));
+    printf("perfect hash:  %8.2f ns/lookup\n",
+           tHash * 1e9 / ((double)nwords * rounds));
+    printf("speedup:       %8.2fx\n", tLinear / tHash);
+    return sumLinear == sumHash ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+/****************************************************/
+/* File: cache.c                                    */
+/* Content-addressed on-disk cache of compilations: */
+/* the listing and TM code of a source program are  */
+/* kept under a hash of its text, the compiler      */
+/* version and the options                          */
+/* An entry is one file named by the 128-bit hash,  */
+/* written to a temporary file and renamed into     */
+/* place; its modification time is its last use     */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "output.h"
+#include "util.h"
+
+/* length of a key in hex digits */
+#define KEYLEN 32
+
+/* longest entry header line */
+#define MAXHEADER 128
+
+/* the cache is evicted down to this share of its
+   limit, so that evictions are not too frequent */
+#define KEEPPERCENT 75
+
+/* hash64 is MurmurHash64A of the n bytes at data */
+static uint64_t hash64(const void* data, size_t n, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const unsigned char* p = data;
+    uint64_t h = seed ^ (n * m), k;
+    while (n >= 8) {
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+        p += 8;
+        n -= 8;
+    }
+    switch (n) {
+        case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+        case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+        case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+        case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+        case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+        case 2: h ^= (uint64_t)p[1] << 8;  /* fall through */
+        case 1:
+            h ^= p[0];
+            h *= m;
+    }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+}
+
+/* makeKey writes the key of a compilation to key,
+   KEYLEN hex digits: two hashes of the text seeded
+   by the hash of the version and the options */
+static int makeKey(const char* text, int length, const TinyOptions* o,
+                   char* key) {
+    Output prefix = {0};
+    uint64_t seed;
+    outPrintf(&prefix, "%s %d %d %d %d %d %d %d %d %s", TINY_VERSION,
+              o->noParse, o->noAnalyze, o->noCode, o->EchoSource,
+              o->TraceScan, o->TraceParse, o->TraceAnalyze, o->TraceCode,
+              o->name ? o->name : "");
+    if (prefix.failed) {
+        outRelease(&prefix);
+        return FALSE;
+    }
+    seed = hash64(prefix.text, prefix.length, 0);
+    sprintf(key, "%016llx%016llx",
+            (unsigned long long)hash64(text, length, seed),
+            (unsigned long long)hash64(text, length, ~seed));
+    outRelease(&prefix);
+    return TRUE;
+}
+
+/* entryName is the file name of an entry (or of a
+   temporary file, when tmp) of the cache, or NULL
+   when out of memory */
+static char* entryName(Cache* c, const char* key, int tmp) {
+    char* name = malloc(strlen(c->dir) + KEYLEN + 48);
+    static long serial;
+    if (name == NULL) return NULL;
+    if (tmp)
+        sprintf(name, "%s/.%s.%ld.%ld", c->dir, key, (long)getpid(),
+                __sync_fetch_and_add(&serial, 1));
+    else
+        sprintf(name, "%s/%s", c->dir, key);
+    return name;
+}
+
+/* lookup reads the entry of key into result; it
+   returns FALSE when there is none (or it is
+   damaged) */
+static int lookup(Cache* c, const char* key, int length,
+                  TinyResult* result) {
+    char* name = entryName(c, key, FALSE);
+    char header[MAXHEADER + 1];
+    char* body = NULL;
+    int fd = name ? open(name, O_RDONLY) : -1;
+    int n, sourceLength, Error, listingLength, codeLength, skip;
+    struct stat st;
+    ssize_t got = 0;
+    free(name);
+    if (fd < 0) return FALSE;
+    if (fstat(fd, &st) == 0 && st.st_size < INT_MAX &&
+        (body = malloc(st.st_size + 1)) != NULL)
+        got = read(fd, body, st.st_size);
+    /* the entry is being used: it moves to the young end */
+    if (body != NULL) futimens(fd, NULL);
+    close(fd);
+    if (body == NULL || got != st.st_size) {
+        free(body);
+        return FALSE;
+    }
+    n = got < MAXHEADER ? (int)got : MAXHEADER;
+    memcpy(header, body, n);
+    header[n] = '\0';
+    if (sscanf(header, "TINYCACHE %d %d %d %d%n", &sourceLength, &Error,
+               &listingLength, &codeLength, &skip) != 4 ||
+        header[skip++] != '\n' || sourceLength != length || listingLength < 0 || codeLength < 0 ||
+        (long long)skip + listingLength + codeLength != got) {
+        free(body);
+        return FALSE;
+    }
+    memset(result, 0, sizeof(*result));
+    result->Error = Error;
+    result->listingLength = listingLength;
+    result->codeLength = codeLength;
+    if (listingLength > 0 &&
+        (result->listing = malloc(listingLength + 1)) != NULL) {
+        memcpy(result->listing, body + skip, listingLength);
+        result->listing[listingLength] = '\0';
+    }
+    if (codeLength > 0 && (result->code = malloc(codeLength + 1)) != NULL) {
+        memcpy(result->code, body + skip + listingLength, codeLength);
+        result->code[codeLength] = '\0';
+    }
+    free(body);
+    if ((listingLength > 0 && result->listing == NULL) ||
+        (codeLength > 0 && result->code == NULL)) {
+        tinyFree(result);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Entry is a file of the cache, for eviction */
+typedef struct {
+    char* name;
+    long long size;
+    time_t used;
+} Entry;
+
+/* compareEntries orders entries least recently
+   used first */
+static int compareEntries(const void* a, const void* b) {
+    time_t x = ((const Entry*)a)->used, y = ((const Entry*)b)->used;
+    return x < y ? -1 : x > y;
+}
+
+/* scan sums the sizes of the entries of c and,
+   when evict, removes the least recently used ones
+   until the cache is back within its limit; it is
+   called with the lock held */
+static void scan(Cache* c, int evict) {
+    DIR* d = opendir(c->dir);
+    struct dirent* e;
+    struct stat st;
+    Entry* entries = NULL;
+    int n = 0, cap = 0, i;
+    long long size = 0, keep = c->limit / 100 * KEEPPERCENT;
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL) {
+        char* name;
+        if (strlen(e->d_name) != KEYLEN) continue;
+        if ((name = entryName(c, e->d_name, FALSE)) == NULL) break;
+        if (stat(name, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(name);
+            continue;
+        }
+        size += st.st_size;
+        if (n == cap) {
+            Entry* grown = realloc(entries, (cap = cap ? 2 * cap : 64) *
+                                                sizeof(Entry));
+            if (grown == NULL) {
+                free(name);
+                break;
+            }
+            entries = grown;
+        }
+        entries[n].name = name;
+        entries[n].size = st.st_size;
+        entries[n++].used = st.st_mtime;
+    }
+    closedir(d);
+    if (evict && size > c->limit) {
+        qsort(entries, n, sizeof(Entry), compareEntries);
+        for (i = 0; i < n && size > keep; i++)
+            if (unlink(entries[i].name) == 0) {
+                size -= entries[i].size;
+                c->evictions++;
+            }
+    }
+    for (i = 0; i < n; i++) free(entries[i].name);
+    free(entries);
+    c->size = size;
+}
+
+/* store enters result as the entry of key, through
+   a temporary file renamed into place so that no
+   reader ever sees it half written */
+static void store(Cache* c, const char* key, int length,
+                  const TinyResult* result) {
+    char header[MAXHEADER];
+    char* tmp = entryName(c, key, TRUE);
+    char* name = entryName(c, key, FALSE);
+    int fd = tmp && name ? open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644) : -1;
+    int n = sprintf(header, "TINYCACHE %d %d %d %d\n", length, result->Error,
+                    result->listingLength, result->codeLength);
+    int ok = fd >= 0 && writeAll(fd, header, n) &&
+             writeAll(fd, result->listing, result->listingLength) &&
+             writeAll(fd, result->code, result->codeLength);
+    if (fd >= 0 && close(fd) != 0) ok = FALSE;
+    if (ok && rename(tmp, name) == 0) {
+        pthread_mutex_lock(&c->lock);
+        c->size += n + result->listingLength + result->codeLength;
+        if (c->size > c->limit) scan(c, TRUE);
+        pthread_mutex_unlock(&c->lock);
+    } else if (fd >= 0)
+        unlink(tmp);
+    free(tmp);
+    free(name);
+}
+
+/* Function cacheOpen opens the cache in directory
+ * dir, creating it if need be, to hold at most
+ * limit bytes; it returns FALSE if dir cannot be
+ * used
+ */
+int cacheOpen(Cache* c, const char* dir, long long limit) {
+    struct stat st;
+    memset(c, 0, sizeof(*c));
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return FALSE;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return FALSE;
+    if ((c->dir = malloc(strlen(dir) + 1)) == NULL) return FALSE;
+    strcpy(c->dir, dir);
+    c->limit = limit;
+    pthread_mutex_init(&c->lock, NULL);
+    scan(c, FALSE);
+    return TRUE;
+}
+
+/* Function cacheCompile compiles the length bytes
+ * of source text as tinyCompile does, taking the
+ * result from the cache when the same text was
+ * compiled with the same options by this version
+ * of the compiler, and storing it otherwise. The
+ * least recently used entries are evicted when the
+ * cache outgrows its limit. A result from the cache
+ * has its phase times all 0
+ */
+int cacheCompile(Cache* c, const char* text, int length,
+                 const TinyOptions* options, TinyResult* result) {
+    static const TinyOptions defaults = {0};
+    char key[KEYLEN + 1];
+    int keyed, hit, ok;
+    if (options == NULL) options = &defaults;
+    if (text == NULL) text = "";
+    keyed = makeKey(text, length, options, key);
+    hit = keyed && lookup(c, key, length, result);
+    pthread_mutex_lock(&c->lock);
+    if (hit)
+        c->hits++;
+    else
+        c->misses++;
+    pthread_mutex_unlock(&c->lock);
+    if (hit) return TRUE;
+    ok = tinyCompile(text, length, options, result);
+    if (ok && keyed) store(c, key, length, result);
+    return ok;
+}
+
+/* Procedure cacheClose releases c; the directory
+ * is left as it is
+ */
+void cacheClose(Cache* c) {
+    pthread_mutex_destroy(&c->lock);
+    free(c->dir);
+    c->dir = NULL;
+}
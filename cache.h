@@ -0,0 +1,60 @@
+/****************************************************/
+/* File: cache.h                                    */
+/* Content-addressed on-disk cache of compilations: */
+/* the listing and TM code of a source program are  */
+/* kept under a hash of its text, the compiler      */
+/* version and the options                          */
+/****************************************************/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+#include <pthread.h>
+
+#include "tiny.h"
+
+/* CACHELIMIT is the size limit in bytes of the
+ * cache of the tt command
+ */
+#ifndef CACHELIMIT
+#define CACHELIMIT (256LL << 20)
+#endif
+
+/* Cache is an open cache directory; the threads of
+ * a process may share one, and processes may share
+ * the directory
+ */
+typedef struct {
+    char* dir;
+    long long limit; /* bytes kept at most */
+    long long size;  /* bytes in the directory, as last known */
+    long hits;
+    long misses;
+    long evictions;
+    pthread_mutex_t lock;
+} Cache;
+
+/* Function cacheOpen opens the cache in directory
+ * dir, creating it if need be, to hold at most
+ * limit bytes; it returns FALSE if dir cannot be
+ * used
+ */
+int cacheOpen(Cache* c, const char* dir, long long limit);
+
+/* Function cacheCompile compiles the length bytes
+ * of source text as tinyCompile does, taking the
+ * result from the cache when the same text was
+ * compiled with the same options by this version
+ * of the compiler, and storing it otherwise. The
+ * least recently used entries are evicted when the
+ * cache outgrows its limit. A result from the cache
+ * has its phase times all 0
+ */
+int cacheCompile(Cache* c, const char* text, int length,
+                 const TinyOptions* options, TinyResult* result);
+
+/* Procedure cacheClose releases c; the directory
+ * is left as it is
+ */
+void cacheClose(Cache* c);
+
+#endif
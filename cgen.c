@@ -10,83 +10,78 @@
 // #include "globals.h"
 #include "cgen.h"
 #include "code.h"
+#include "compiler.h"
 #include "symtab.h"
 
-/* tmpOffset is the memory offset for temps
-   It is decremented each time a temp is
-   stored, and incremeted when loaded again
-*/
-static int tmpOffset = 0;
-
 /* prototype for internal recursive code generator */
-static void cGen(TreeNode* tree);
+static void cGen(Compiler* ctx, Ast* ast, AstRef tree);
 
 /* Procedure genStmt generates code at a statement node */
-static void genStmt(TreeNode* tree) {
-    TreeNode *p1, *p2, *p3;
+static void genStmt(Compiler* ctx, Ast* ast, AstRef tree) {
+    AstRef p1, p2, p3;
     int savedLoc1, savedLoc2, currentLoc;
     int loc;
-    switch (tree->kind.stmt) {
+    switch (astStmtKind(ast, tree)) {
         case IfK:
-            if (TraceCode) emitComment("-> if");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
-            p3 = tree->child[2];
+            if (ctx->TraceCode) emitComment(ctx, "-> if");
+            p1 = astChild(ast, tree, 0);
+            p2 = astChild(ast, tree, 1);
+            p3 = astChild(ast, tree, 2);
             /* generate code for test expression */
-            cGen(p1);
-            savedLoc1 = emitSkip(1);
-            emitComment("if: jump to else belongs here");
+            cGen(ctx, ast, p1);
+            savedLoc1 = emitSkip(ctx, 1);
+            emitComment(ctx, "if: jump to else belongs here");
             /* recurse on then part */
-            cGen(p2);
-            savedLoc2 = emitSkip(1);
-            emitComment("if: jump to end belongs here");
-            currentLoc = emitSkip(0);
-            emitBackup(savedLoc1);
-            emitRM_Abs("JEQ", ac, currentLoc, "if: jmp to else");
-            emitRestore();
+            cGen(ctx, ast, p2);
+            savedLoc2 = emitSkip(ctx, 1);
+            emitComment(ctx, "if: jump to end belongs here");
+            currentLoc = emitSkip(ctx, 0);
+            emitBackup(ctx, savedLoc1);
+            emitRM_Abs(ctx, "JEQ", ac, currentLoc, "if: jmp to else");
+            emitRestore(ctx);
             /* recurse on else part */
-            cGen(p3);
-            currentLoc = emitSkip(0);
-            emitBackup(savedLoc2);
-            emitRM_Abs("LDA", pc, currentLoc, "jmp to end");
-            emitRestore();
-            if (TraceCode) emitComment("<- if");
+            cGen(ctx, ast, p3);
+            currentLoc = emitSkip(ctx, 0);
+            emitBackup(ctx, savedLoc2);
+            emitRM_Abs(ctx, "LDA", pc, currentLoc, "jmp to end");
+            emitRestore(ctx);
+            if (ctx->TraceCode) emitComment(ctx, "<- if");
             break; /* if_k */
 
         case RepeatK:
-            if (TraceCode) emitComment("-> repeat");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
-            savedLoc1 = emitSkip(0);
-            emitComment("repeat: jump after body comes back here");
+            if (ctx->TraceCode) emitComment(ctx, "-> repeat");
+            p1 = astChild(ast, tree, 0);
+            p2 = astChild(ast, tree, 1);
+            savedLoc1 = emitSkip(ctx, 0);
+            emitComment(ctx, "repeat: jump after body comes back here");
             /* generate code for body */
-            cGen(p1);
+            cGen(ctx, ast, p1);
             /* generate code for test */
-            cGen(p2);
-            emitRM_Abs("JEQ", ac, savedLoc1, "repeat: jmp back to body");
-            if (TraceCode) emitComment("<- repeat");
+            cGen(ctx, ast, p2);
+            emitRM_Abs(ctx, "JEQ", ac, savedLoc1, "repeat: jmp back to body");
+            if (ctx->TraceCode) emitComment(ctx, "<- repeat");
             break; /* repeat */
 
         case AssignK:
-            if (TraceCode) emitComment("-> assign");
+            if (ctx->TraceCode) emitComment(ctx, "-> assign");
             /* generate code for rhs */
-            cGen(tree->child[0]);
+            cGen(ctx, ast, astChild(ast, tree, 0));
             /* now store value */
-            loc = st_lookup(tree->attr.name);
-            emitRM("ST", ac, loc, gp, "assign: store value");
-            if (TraceCode) emitComment("<- assign");
+            loc = st_lookup(&ctx->symtab, astName(ast, tree));
+            emitRM(ctx, "ST", ac, loc, gp, "assign: store value");
+            if (ctx->TraceCode) emitComment(ctx, "<- assign");
             break; /* assign_k */
 
         case ReadK:
-            emitRO("IN", ac, 0, 0, "read integer value");
-            loc = st_lookup(tree->attr.name);
-            emitRM("ST", ac, loc, gp, "read: store value");
+            emitRO(ctx, "IN", ac, 0, 0, "read integer value");
+            loc = st_lookup(&ctx->symtab, astName(ast, tree));
+            emitRM(ctx, "ST", ac, loc, gp, "read: store value");
             break;
         case WriteK:
             /* generate code for expression to write */
-            cGen(tree->child[0]);
+            cGen(ctx, ast, astChild(ast, tree, 0));
             /* now output it */
-            emitRO("OUT", ac, 0, 0, "write ac");
+            emitRO(ctx, "OUT", ac, 0, 0, "write ac");
             break;
         default:
             break;
@@ -94,68 +89,68 @@ static void genStmt(TreeNode* tree) {
 } /* genStmt */
 
 /* Procedure genExp generates code at an expression node */
-static void genExp(TreeNode* tree) {
+static void genExp(Compiler* ctx, Ast* ast, AstRef tree) {
     int loc;
-    TreeNode *p1, *p2;
-    switch (tree->kind.exp) {
+    AstRef p1, p2;
+    switch (astExpKind(ast, tree)) {
         case ConstK:
-            if (TraceCode) emitComment("-> Const");
+            if (ctx->TraceCode) emitComment(ctx, "-> Const");
             /* gen code to load integer constant using LDC */
-            emitRM("LDC", ac, tree->attr.val, 0, "load const");
-            if (TraceCode) emitComment("<- Const");
+            emitRM(ctx, "LDC", ac, astVal(ast, tree), 0, "load const");
+            if (ctx->TraceCode) emitComment(ctx, "<- Const");
             break; /* ConstK */
 
         case IdK:
-            if (TraceCode) emitComment("-> Id");
-            loc = st_lookup(tree->attr.name);
-            emitRM("LD", ac, loc, gp, "load id value");
-            if (TraceCode) emitComment("<- Id");
+            if (ctx->TraceCode) emitComment(ctx, "-> Id");
+            loc = st_lookup(&ctx->symtab, astName(ast, tree));
+            emitRM(ctx, "LD", ac, loc, gp, "load id value");
+            if (ctx->TraceCode) emitComment(ctx, "<- Id");
             break; /* IdK */
 
         case OpK:
-            if (TraceCode) emitComment("-> Op");
-            p1 = tree->child[0];
-            p2 = tree->child[1];
+            if (ctx->TraceCode) emitComment(ctx, "-> Op");
+            p1 = astChild(ast, tree, 0);
+            p2 = astChild(ast, tree, 1);
             /* gen code for ac = left arg */
-            cGen(p1);
+            cGen(ctx, ast, p1);
             /* gen code to push left operand */
-            emitRM("ST", ac, tmpOffset--, mp, "op: push left");
+            emitRM(ctx, "ST", ac, ctx->tmpOffset--, mp, "op: push left");
             /* gen code for ac = right operand */
-            cGen(p2);
+            cGen(ctx, ast, p2);
             /* now load left operand */
-            emitRM("LD", ac1, ++tmpOffset, mp, "op: load left");
-            switch (tree->attr.op) {
+            emitRM(ctx, "LD", ac1, ++ctx->tmpOffset, mp, "op: load left");
+            switch (astOp(ast, tree)) {
                 case PLUS:
-                    emitRO("ADD", ac, ac1, ac, "op +");
+                    emitRO(ctx, "ADD", ac, ac1, ac, "op +");
                     break;
                 case MINUS:
-                    emitRO("SUB", ac, ac1, ac, "op -");
+                    emitRO(ctx, "SUB", ac, ac1, ac, "op -");
                     break;
                 case TIMES:
-                    emitRO("MUL", ac, ac1, ac, "op *");
+                    emitRO(ctx, "MUL", ac, ac1, ac, "op *");
                     break;
                 case OVER:
-                    emitRO("DIV", ac, ac1, ac, "op /");
+                    emitRO(ctx, "DIV", ac, ac1, ac, "op /");
                     break;
                 case LT:
-                    emitRO("SUB", ac, ac1, ac, "op <");
-                    emitRM("JLT", ac, 2, pc, "br if true");
-                    emitRM("LDC", ac, 0, ac, "false case");
-                    emitRM("LDA", pc, 1, pc, "unconditional jmp");
-                    emitRM("LDC", ac, 1, ac, "true case");
+                    emitRO(ctx, "SUB", ac, ac1, ac, "op <");
+                    emitRM(ctx, "JLT", ac, 2, pc, "br if true");
+                    emitRM(ctx, "LDC", ac, 0, ac, "false case");
+                    emitRM(ctx, "LDA", pc, 1, pc, "unconditional jmp");
+                    emitRM(ctx, "LDC", ac, 1, ac, "true case");
                     break;
                 case EQ:
-                    emitRO("SUB", ac, ac1, ac, "op ==");
-                    emitRM("JEQ", ac, 2, pc, "br if true");
-                    emitRM("LDC", ac, 0, ac, "false case");
-                    emitRM("LDA", pc, 1, pc, "unconditional jmp");
-                    emitRM("LDC", ac, 1, ac, "true case");
+                    emitRO(ctx, "SUB", ac, ac1, ac, "op ==");
+                    emitRM(ctx, "JEQ", ac, 2, pc, "br if true");
+                    emitRM(ctx, "LDC", ac, 0, ac, "false case");
+                    emitRM(ctx, "LDA", pc, 1, pc, "unconditional jmp");
+                    emitRM(ctx, "LDC", ac, 1, ac, "true case");
                     break;
                 default:
-                    emitComment("BUG: Unknown operator");
+                    emitComment(ctx, "BUG: Unknown operator");
                     break;
             } /* case op */
-            if (TraceCode) emitComment("<- Op");
+            if (ctx->TraceCode) emitComment(ctx, "<- Op");
             break; /* OpK */
 
         default:
@@ -163,25 +158,28 @@ static void genExp(TreeNode* tree) {
     }
 } /* genExp */
 
-/* Procedure cGen recursively generates code by
- * tree traversal
- */
-static void cGen(TreeNode* tree) {
-    if (tree != NULL) {
-        switch (tree->nodekind) {
-            case StmtK:
-                genStmt(tree);
-                break;
-            case ExpK:
-                genExp(tree);
-                break;
-            default:
-                break;
-        }
-        cGen(tree->sibling);
+/* Procedure genNode generates code at a node */
+static void genNode(Compiler* ctx, Ast* ast, AstRef tree) {
+    switch (astNodeKind(ast, tree)) {
+        case StmtK:
+            genStmt(ctx, ast, tree);
+            break;
+        case ExpK:
+            genExp(ctx, ast, tree);
+            break;
+        default:
+            break;
     }
 }
 
+/* Procedure cGen generates code by tree traversal,
+ * recursing into children but looping over siblings,
+ * so that its stack grows with nesting depth only
+ */
+static void cGen(Compiler* ctx, Ast* ast, AstRef tree) {
+    for (; tree != 0; tree = astSibling(ast, tree)) genNode(ctx, ast, tree);
+}
+
 /**********************************************/
 /* the primary function of the code generator */
 /**********************************************/
@@ -191,20 +189,46 @@ static void cGen(TreeNode* tree) {
  * of the code file, and is used to print the
  * file name as a comment in the code file
  */
-void codeGen(TreeNode* syntaxTree, char* codefile) {
+void codeGen(Compiler* ctx, Ast* syntaxTree, char* codefile) {
+    codeGenStart(ctx, codefile);
+    /* generate code for TINY program */
+    codeGenTree(ctx, syntaxTree, syntaxTree->root);
+    codeGenEnd(ctx);
+}
+
+/* Procedure codeGenStart generates the header
+ * comments and the standard prelude, as codeGen
+ * does before the code of the program
+ */
+void codeGenStart(Compiler* ctx, char* codefile) {
     char* s = malloc(strlen(codefile) + 7);
     strcpy(s, "File: ");
     strcat(s, codefile);
-    emitComment("TINY Compilation to TM Code");
-    emitComment(s);
+    emitComment(ctx, "TINY Compilation to TM Code");
+    emitComment(ctx, s);
     /* generate standard prelude */
-    emitComment("Standard prelude:");
-    emitRM("LD", mp, 0, ac, "load maxaddress from location 0");
-    emitRM("ST", ac, 0, ac, "clear location 0");
-    emitComment("End of standard prelude.");
-    /* generate code for TINY program */
-    cGen(syntaxTree);
-    /* finish */
-    emitComment("End of execution.");
-    emitRO("HALT", 0, 0, 0, "");
+    emitComment(ctx, "Standard prelude:");
+    emitRM(ctx, "LD", mp, 0, ac, "load maxaddress from location 0");
+    emitRM(ctx, "ST", ac, 0, ac, "clear location 0");
+    emitComment(ctx, "End of standard prelude.");
+    free(s);
+}
+
+/* Procedure codeGenTree generates code for the
+ * tree t and its siblings at the current location
+ */
+void codeGenTree(Compiler* ctx, Ast* ast, AstRef t) { cGen(ctx, ast, t); }
+
+/* Procedure codeGenNode generates code for the
+ * tree t alone, not its siblings, at the current
+ * location
+ */
+void codeGenNode(Compiler* ctx, Ast* ast, AstRef t) { genNode(ctx, ast, t); }
+
+/* Procedure codeGenEnd generates the end of the
+ * program, as codeGen does after its code
+ */
+void codeGenEnd(Compiler* ctx) {
+    emitComment(ctx, "End of execution.");
+    emitRO(ctx, "HALT", 0, 0, 0, "");
 }
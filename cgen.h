@@ -7,6 +7,7 @@
 
 #ifndef _CGEN_H_
 #define _CGEN_H_
+#include "ast.h"
 #include "globals.h"
 
 /* Procedure codeGen generates code to a code
@@ -15,6 +16,28 @@
  * of the code file, and is used to print the
  * file name as a comment in the code file
  */
-void codeGen(TreeNode* syntaxTree, char* codefile);
+void codeGen(Compiler* ctx, Ast* syntaxTree, char* codefile);
+
+/* Procedure codeGenStart generates the header
+ * comments and the standard prelude, as codeGen
+ * does before the code of the program
+ */
+void codeGenStart(Compiler* ctx, char* codefile);
+
+/* Procedure codeGenTree generates code for the
+ * tree t and its siblings at the current location
+ */
+void codeGenTree(Compiler* ctx, Ast* ast, AstRef t);
+
+/* Procedure codeGenNode generates code for the
+ * tree t alone, not its siblings, at the current
+ * location
+ */
+void codeGenNode(Compiler* ctx, Ast* ast, AstRef t);
+
+/* Procedure codeGenEnd generates the end of the
+ * program, as codeGen does after its code
+ */
+void codeGenEnd(Compiler* ctx);
 
 #endif
@@ -8,20 +8,13 @@
 
 #include "globals.h"
 #include "code.h"
-
-/* TM location number for current instruction emission */
-static int emitLoc = 0 ;
-
-/* Highest TM location emitted so far
-   For use in conjunction with emitSkip,
-   emitBackup, and emitRestore */
-static int highEmitLoc = 0;
+#include "compiler.h"
 
 /* Procedure emitComment prints a comment line 
  * with comment c in the code file
  */
-void emitComment( char * c )
-{ if (TraceCode) fprintf(code,"* %s\n",c);}
+void emitComment( Compiler * ctx, char * c )
+{ if (ctx->TraceCode) outPrintf(&ctx->code,"* %s\n",c);}
 
 /* Procedure emitRO emits a register-only
  * TM instruction
@@ -31,11 +24,11 @@ void emitComment( char * c )
  * t = 2nd source register
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRO( char *op, int r, int s, int t, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+void emitRO( Compiler * ctx, char *op, int r, int s, int t, char *c)
+{ outPrintf(&ctx->code,"%3d:  %5s  %d,%d,%d ",ctx->emitLoc++,op,r,s,t);
+  if (ctx->TraceCode) outPrintf(&ctx->code,"\t%s",c) ;
+  outPrintf(&ctx->code,"\n") ;
+  if (ctx->highEmitLoc < ctx->emitLoc) ctx->highEmitLoc = ctx->emitLoc ;
 } /* emitRO */
 
 /* Procedure emitRM emits a register-to-memory
@@ -46,38 +39,38 @@ void emitRO( char *op, int r, int s, int t, char *c)
  * s = the base register
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRM( char * op, int r, int d, int s, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
+void emitRM( Compiler * ctx, char * op, int r, int d, int s, char *c)
+{ outPrintf(&ctx->code,"%3d:  %5s  %d,%d(%d) ",ctx->emitLoc++,op,r,d,s);
+  if (ctx->TraceCode) outPrintf(&ctx->code,"\t%s",c) ;
+  outPrintf(&ctx->code,"\n") ;
+  if (ctx->highEmitLoc < ctx->emitLoc)  ctx->highEmitLoc = ctx->emitLoc ;
 } /* emitRM */
 
 /* Function emitSkip skips "howMany" code
  * locations for later backpatch. It also
  * returns the current code position
  */
-int emitSkip( int howMany)
-{  int i = emitLoc;
-   emitLoc += howMany ;
-   if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
+int emitSkip( Compiler * ctx, int howMany)
+{  int i = ctx->emitLoc;
+   ctx->emitLoc += howMany ;
+   if (ctx->highEmitLoc < ctx->emitLoc)  ctx->highEmitLoc = ctx->emitLoc ;
    return i;
 } /* emitSkip */
 
 /* Procedure emitBackup backs up to 
  * loc = a previously skipped location
  */
-void emitBackup( int loc)
-{ if (loc > highEmitLoc) emitComment("BUG in emitBackup");
-  emitLoc = loc ;
+void emitBackup( Compiler * ctx, int loc)
+{ if (loc > ctx->highEmitLoc) emitComment(ctx,"BUG in emitBackup");
+  ctx->emitLoc = loc ;
 } /* emitBackup */
 
 /* Procedure emitRestore restores the current 
  * code position to the highest previously
  * unemitted position
  */
-void emitRestore(void)
-{ emitLoc = highEmitLoc;}
+void emitRestore( Compiler * ctx )
+{ ctx->emitLoc = ctx->highEmitLoc;}
 
 /* Procedure emitRM_Abs converts an absolute reference 
  * to a pc-relative reference when emitting a
@@ -87,11 +80,35 @@ void emitRestore(void)
  * a = the absolute location in memory
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRM_Abs( char *op, int r, int a, char * c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",
-               emitLoc,op,r,a-(emitLoc+1),pc);
-  ++emitLoc ;
-  if (TraceCode) fprintf(code,"\t%s",c) ;
-  fprintf(code,"\n") ;
-  if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
+void emitRM_Abs( Compiler * ctx, char *op, int r, int a, char * c)
+{ outPrintf(&ctx->code,"%3d:  %5s  %d,%d(%d) ",
+               ctx->emitLoc,op,r,a-(ctx->emitLoc+1),pc);
+  ++ctx->emitLoc ;
+  if (ctx->TraceCode) outPrintf(&ctx->code,"\t%s",c) ;
+  outPrintf(&ctx->code,"\n") ;
+  if (ctx->highEmitLoc < ctx->emitLoc) ctx->highEmitLoc = ctx->emitLoc ;
 } /* emitRM_Abs */
+
+/* Procedure emitCode copies code generated from
+ * location 0, length characters taking size
+ * locations, to the current location: every
+ * reference in the code is pc-relative, so only
+ * the location at the start of each line changes
+ */
+void emitCode( Compiler * ctx, const char * code, int length, int size)
+{ const char * end = code + length;
+  while (code < end)
+  { const char * eol = memchr(code,'\n',end-code);
+    int n = eol ? (int)(eol-code)+1 : (int)(end-code);
+    char * colon;
+    long loc = strtol(code,&colon,10);
+    if (colon != code && *colon == ':')
+    { outPrintf(&ctx->code,"%3ld",loc+ctx->emitLoc);
+      outWrite(&ctx->code,colon,n-(int)(colon-code));
+    }
+    else outWrite(&ctx->code,code,n);
+    code += n;
+  }
+  ctx->emitLoc += size;
+  if (ctx->highEmitLoc < ctx->emitLoc) ctx->highEmitLoc = ctx->emitLoc ;
+} /* emitCode */
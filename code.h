@@ -8,6 +8,7 @@
 
 #ifndef _CODE_H_
 #define _CODE_H_
+#include "globals.h"
 
 /* pc = program counter  */
 #define  pc 7
@@ -34,7 +35,7 @@
 /* Procedure emitComment prints a comment line 
  * with comment c in the code file
  */
-void emitComment( char * c );
+void emitComment( Compiler * ctx, char * c );
 
 /* Procedure emitRO emits a register-only
  * TM instruction
@@ -44,7 +45,7 @@ void emitComment( char * c );
  * t = 2nd source register
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRO( char *op, int r, int s, int t, char *c);
+void emitRO( Compiler * ctx, char *op, int r, int s, int t, char *c);
 
 /* Procedure emitRM emits a register-to-memory
  * TM instruction
@@ -54,24 +55,24 @@ void emitRO( char *op, int r, int s, int t, char *c);
  * s = the base register
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRM( char * op, int r, int d, int s, char *c);
+void emitRM( Compiler * ctx, char * op, int r, int d, int s, char *c);
 
 /* Function emitSkip skips "howMany" code
  * locations for later backpatch. It also
  * returns the current code position
  */
-int emitSkip( int howMany);
+int emitSkip( Compiler * ctx, int howMany);
 
 /* Procedure emitBackup backs up to 
  * loc = a previously skipped location
  */
-void emitBackup( int loc);
+void emitBackup( Compiler * ctx, int loc);
 
 /* Procedure emitRestore restores the current 
  * code position to the highest previously
  * unemitted position
  */
-void emitRestore(void);
+void emitRestore( Compiler * ctx );
 
 /* Procedure emitRM_Abs converts an absolute reference 
  * to a pc-relative reference when emitting a
@@ -81,6 +82,14 @@ void emitRestore(void);
  * a = the absolute location in memory
  * c = a comment to be printed if TraceCode is TRUE
  */
-void emitRM_Abs( char *op, int r, int a, char * c);
+void emitRM_Abs( Compiler * ctx, char *op, int r, int a, char * c);
+
+/* Procedure emitCode copies code generated from
+ * location 0, length characters taking size
+ * locations, to the current location: every
+ * reference in the code is pc-relative, so only
+ * the location at the start of each line changes
+ */
+void emitCode( Compiler * ctx, const char * code, int length, int size);
 
 #endif
@@ -1,4 +1,6 @@
 #!/bin/bash
-gcc -g -std=c99 ./*.h ./*.c -o ./tt
+gcc -g -std=c99 ./*.h ./*.c -o ./tt -pthread
+# libtiny.a: the compiler without main.c, as a library (tiny.h)
+gcc -g -std=c99 -c $(ls ./*.c | grep -v main.c) && ar rcs libtiny.a ./*.o && rm ./*.o
 ./tt ./sample.tny # 正例
 # ./tt ./syn.tny # 反例
\ No newline at end of file
@@ -0,0 +1,32 @@
+/****************************************************/
+/* File: compiler.c                                 */
+/* The state of one compilation of the TINY         */
+/* compiler, passed to every phase                  */
+/****************************************************/
+
+#include "compiler.h"
+
+/* Procedure initCompiler prepares ctx for compiling
+ * source to listing, every tracing flag being off;
+ * a NULL listing (and the code, until its file is
+ * set) is kept in memory
+ */
+void initCompiler(Compiler* ctx, FILE* source, FILE* listing) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->source = source;
+    ctx->listing.file = listing;
+}
+
+/* Procedure freeCompiler releases the source text,
+ * the tables and the buffered output of ctx; the
+ * files are left open
+ */
+void freeCompiler(Compiler* ctx) {
+    closeSource(ctx);
+    arenaRelease(&ctx->arena);
+    freeAtoms(&ctx->atoms);
+    freeSymTab(&ctx->symtab);
+    outRelease(&ctx->listing);
+    outRelease(&ctx->code);
+    outRelease(&ctx->checks);
+}
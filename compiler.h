@@ -0,0 +1,113 @@
+/****************************************************/
+/* File: compiler.h                                 */
+/* The state of one compilation of the TINY         */
+/* compiler, passed to every phase                  */
+/****************************************************/
+
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+#include "arena.h"
+#include "atom.h"
+#include "globals.h"
+#include "output.h"
+#include "scan.h"
+#include "symtab.h"
+
+struct Compiler {
+    FILE* source;   /* source code text file */
+    Output listing; /* listing output */
+    Output code;    /* code for TM simulator */
+
+    int lineno; /* source line number for listing */
+
+    /* Error = TRUE prevents further passes if an error occurs */
+    int Error;
+
+    /* EchoSource = TRUE causes the source program to
+     * be echoed to the listing file with line numbers
+     * during parsing
+     */
+    int EchoSource;
+
+    /* TraceScan = TRUE causes token information to be
+     * printed to the listing file as each token is
+     * recognized by the scanner
+     */
+    int TraceScan;
+
+    /* TraceParse = TRUE causes the syntax tree to be
+     * printed to the listing file in linearized form
+     * (using indents for children)
+     */
+    int TraceParse;
+
+    /* TraceAnalyze = TRUE causes symbol table inserts
+     * and lookups to be reported to the listing file
+     */
+    int TraceAnalyze;
+
+    /* TraceCode = TRUE causes comments to be written
+     * to the TM code file as code is generated
+     */
+    int TraceCode;
+
+    /* scanner (scan.c): the whole source program, the
+       scanner behind getToken and its current token */
+    const char* sourceText;
+    int sourceLength;
+    int sourceMapped;
+    int sourceBorrowed; /* the caller's text (useSource) */
+    Scanner scanner;
+    int scannerReady;
+    char tokenString[MAXTOKENLEN + 1];
+    int tokenStart;
+    int tokenLength;
+    int tokenValue;
+    double tokenFloat;
+
+    /* parser (parse.c): the token stream and the
+       current token */
+    TokenStream* tokens;
+    int tokenIndex;
+    TokenType token;
+    int column;    /* of the current token, from 1 */
+    int lineStart; /* offset of its line, -1 before the first */
+
+    AtomTable atoms; /* interned identifiers */
+    Arena arena;     /* syntax tree nodes and strings */
+    SymTab symtab;
+
+    int location; /* next variable memory location (analyze.c) */
+
+    /* analysis fused with parsing (analyze.c): with
+       fuseAnalysis set, the parser enters the symbols
+       and checks the types as it builds the nodes,
+       keeping the type errors in checks until the
+       analysis phase lists them */
+    int fuseAnalysis;
+    int fuseFailed; /* out of memory in the symbol table */
+    Output checks;
+    int checkError; /* TRUE if checks has a type error */
+
+    int tmpOffset; /* memory offset for temps (cgen.c) */
+
+    /* TM location of the next instruction and highest
+       location emitted so far (code.c) */
+    int emitLoc;
+    int highEmitLoc;
+};
+
+/* Procedure initCompiler prepares ctx for compiling
+ * source to listing, every tracing flag being off;
+ * a NULL listing (and the code, until its file is
+ * set) is kept in memory
+ */
+void initCompiler(Compiler* ctx, FILE* source, FILE* listing);
+
+/* Procedure freeCompiler releases the source text,
+ * the tables and the buffered output of ctx; the
+ * files are left open
+ */
+void freeCompiler(Compiler* ctx);
+
+#endif
@@ -67,11 +67,13 @@ typedef enum
   RSQU,  /* 右中括号 */
   FLOAT } TokenType;
 
-extern FILE* source;  /* source code text file */
-extern FILE* listing; /* listing output text file */
-extern FILE* code;    /* code text file for TM simulator */
-
-extern int lineno; /* source line number for listing */
+/* Compiler holds the state of one compilation:
+ * files, tracing flags, line number, error flag and
+ * the tables of every phase (see compiler.h). Each
+ * phase takes it as its first argument, so several
+ * compilations can run at once on different threads
+ */
+typedef struct Compiler Compiler;
 
 /**************************************************/
 /***********   Syntax tree for parsing ************/
@@ -121,6 +123,7 @@ typedef struct treeNode {
     struct treeNode* child[MAXCHILDREN];
     struct treeNode* sibling;
     int lineno;
+    int column; /* of the name, or of the first token, from 1 */
     NodeKind nodekind;
     union {
         StmtKind stmt;
@@ -141,38 +144,4 @@ typedef struct treeNode {
     ExpType type; /* for type checking of exps */
 } TreeNode;
 
-/**************************************************/
-/***********   Flags for tracing       ************/
-/**************************************************/
-
-/* EchoSource = TRUE causes the source program to
- * be echoed to the listing file with line numbers
- * during parsing
- */
-extern int EchoSource;
-
-/* TraceScan = TRUE causes token information to be
- * printed to the listing file as each token is
- * recognized by the scanner
- */
-extern int TraceScan;
-
-/* TraceParse = TRUE causes the syntax tree to be
- * printed to the listing file in linearized form
- * (using indents for children)
- */
-extern int TraceParse;
-
-/* TraceAnalyze = TRUE causes symbol table inserts
- * and lookups to be reported to the listing file
- */
-extern int TraceAnalyze;
-
-/* TraceCode = TRUE causes comments to be written
- * to the TM code file as code is generated
- */
-extern int TraceCode;
-
-/* Error = TRUE prevents further passes if an error occurs */
-extern int Error;
 #endif
@@ -0,0 +1,526 @@
+/****************************************************/
+/* File: incr.c                                     */
+/* Incremental recompilation: a program kept in     */
+/* memory between edits and compiled again one      */
+/* top-level statement at a time                    */
+/* Each unit keeps its tree, its part of the        */
+/* listing, the names it enters in the symbol table */
+/* and its code, generated from location 0. An edit */
+/* is scanned again by relexTokens, and the units   */
+/* are parsed again from the one holding the first  */
+/* changed token until a unit ends where an old one */
+/* started, on a line past the changed tokens       */
+/****************************************************/
+
+#include "incr.h"
+
+#include "analyze.h"
+#include "ast.h"
+#include "cgen.h"
+#include "code.h"
+#include "compiler.h"
+#include "parse.h"
+#include "plex.h"
+#include "relex.h"
+#include "symtab.h"
+#include "util.h"
+
+/* Use is a global name that a unit enters in the
+   symbol table, with its reference, at a line
+   counted from the first line of the unit, and the
+   location it had when the code of the unit was
+   generated */
+typedef struct {
+    char* name;
+    XRef ref;
+    int loc;
+} Use;
+
+/* Unit is a top-level statement of a program */
+typedef struct {
+    int first; /* its first token */
+    int line;  /* the first line, for the line numbers of its tree */
+    Ast* ast;
+    Output tree; /* its part of the syntax tree listing */
+    Use* uses;
+    int nuses;
+    Output checks; /* its type errors */
+    int failed;    /* TRUE if it has type errors */
+    Output code;   /* its code, from location 0 */
+    int size;      /* the locations its code takes */
+    int coded;     /* TRUE if its code is up to date */
+} Unit;
+
+struct Program {
+    Compiler ctx;
+    TinyOptions options;
+    char* name;     /* copy of the name in options */
+    char* codefile; /* for the code header */
+    char* text;
+    int length;
+    TokenStream tokens;
+    Unit* units; /* none when the program is kept whole */
+    int count;
+};
+
+/* freeUnit releases what u holds */
+static void freeUnit(Unit* u) {
+    freeAst(u->ast);
+    outRelease(&u->tree);
+    outRelease(&u->checks);
+    outRelease(&u->code);
+    free(u->uses);
+}
+
+/* freeUnits releases the units of p */
+static void freeUnits(Program* p) {
+    int i;
+    for (i = 0; i < p->count; i++) freeUnit(&p->units[i]);
+    free(p->units);
+    p->units = NULL;
+    p->count = 0;
+}
+
+/* UseList collects the uses of a unit */
+typedef struct {
+    Unit* unit;
+    int capacity;
+    int ok;
+} UseList;
+
+/* addUse enters the reference ref to the global
+   name in the uses of the unit of the UseList arg */
+static void addUse(char* name, const XRef* ref, void* arg) {
+    UseList* list = arg;
+    Unit* u = list->unit;
+    if (!list->ok) return;
+    if (u->nuses == list->capacity) {
+        int capacity = list->capacity ? 2 * list->capacity : 16;
+        Use* uses = realloc(u->uses, capacity * sizeof(Use));
+        if (uses == NULL) {
+            list->ok = FALSE;
+            return;
+        }
+        u->uses = uses;
+        list->capacity = capacity;
+    }
+    u->uses[u->nuses].name = name;
+    u->uses[u->nuses].ref = *ref;
+    u->uses[u->nuses].ref.lineno -= u->line;
+    u->uses[u->nuses++].loc = -1;
+}
+
+/* parseUnit parses the unit that starts at token
+   first into u, and sets *next to the first token
+   of the next unit, or to -1 at the end of the
+   program; it returns FALSE on a syntax error or
+   when out of memory, u still to be freed */
+static int parseUnit(Program* p, int first, Unit* u, int* next) {
+    Compiler* ctx = &p->ctx;
+    TreeNode* t = parseStatement(ctx, &p->tokens, first);
+    UseList list = {u, 0, TRUE};
+    SymTab scopes = {0}; /* for the parameters and locals */
+    memset(u, 0, sizeof(*u));
+    u->first = first;
+    u->line = p->tokens.line[first];
+    if (t != NULL && !ctx->Error) u->ast = buildAst(&ctx->atoms, t);
+    arenaRelease(&ctx->arena);
+    if (u->ast == NULL || ctx->Error) return FALSE;
+    /* the separator, as stmt_sequence wants it */
+    if (ctx->token == SEMI)
+        *next = ctx->tokenIndex + 1;
+    else if (ctx->token == ENDFILE)
+        *next = -1;
+    else
+        return FALSE;
+    if (p->options.TraceParse) printTree(&u->tree, u->ast, u->ast->root);
+    if (!p->options.noAnalyze &&
+        !walkSymbols(u->ast, u->ast->root, &scopes, addUse, &list))
+        list.ok = FALSE;
+    freeSymTab(&scopes);
+    return list.ok && !u->tree.failed;
+}
+
+/* findUnit returns the last unit of p starting at
+   or before token, or 0 */
+static int findUnit(Program* p, int token) {
+    int lo = 0, hi = p->count - 1, mid;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (p->units[mid].first <= token)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* parseUnits parses the units from token first on
+   into a new array *units of *count units. Without
+   an edit it goes on to the end of the program;
+   after edit, it stops at a unit starting where an
+   old unit did, on a line past the new tokens and
+   the token after them, setting *resume to the
+   index of that unit (to the number of units of p
+   when it got to the end). It returns FALSE on a
+   syntax error or when out of memory */
+static int parseUnits(Program* p, int first, const TokenEdit* edit,
+                      Unit** units, int* count, int* resume) {
+    Unit* fresh = NULL;
+    int n = 0, capacity = 0, next, m, i;
+    *resume = p->count;
+    for (;;) {
+        if (n == capacity) {
+            Unit* grown;
+            capacity = capacity ? 2 * capacity : 16;
+            if ((grown = realloc(fresh, capacity * sizeof(Unit))) == NULL)
+                break;
+            fresh = grown;
+        }
+        if (!parseUnit(p, first, &fresh[n], &next)) {
+            freeUnit(&fresh[n]);
+            break;
+        }
+        n++;
+        if (next < 0) {
+            *units = fresh;
+            *count = n;
+            return TRUE;
+        }
+        /* past the line of token last, the old units
+           keep the columns of their names too */
+        if (edit != NULL && next > edit->last &&
+            p->tokens.line[next] > p->tokens.line[edit->last]) {
+            /* the tokens from next on are old ones */
+            int old = next - (edit->last - edit->oldLast);
+            m = findUnit(p, old);
+            if (p->units[m].first == old) {
+                *resume = m;
+                *units = fresh;
+                *count = n;
+                return TRUE;
+            }
+        }
+        first = next;
+    }
+    for (i = 0; i < n; i++) freeUnit(&fresh[i]);
+    free(fresh);
+    return FALSE;
+}
+
+/* sameNames tells whether the units a (na of them)
+   and b (nb) enter the same names in the same order,
+   so that every location stays as it was */
+static int sameNames(const Unit* a, int na, const Unit* b, int nb) {
+    int i = 0, j = 0, ia = 0, ib = 0;
+    for (;;) {
+        while (ia < na && i == a[ia].nuses) {
+            ia++;
+            i = 0;
+        }
+        while (ib < nb && j == b[ib].nuses) {
+            ib++;
+            j = 0;
+        }
+        if (ia == na || ib == nb) return ia == na && ib == nb;
+        if (a[ia].uses[i++].name != b[ib].uses[j++].name) return FALSE;
+    }
+}
+
+/* checkUnit type checks u, keeping its errors; the
+   line numbers of its tree are first brought up to
+   date with its first token */
+static int checkUnit(Program* p, Unit* u) {
+    Compiler* ctx = &p->ctx;
+    Output listing = ctx->listing;
+    int line = p->tokens.line[u->first];
+    if (line != u->line) {
+        astMoveLines(u->ast, line - u->line);
+        u->line = line;
+    }
+    outRelease(&u->checks);
+    ctx->listing = u->checks;
+    ctx->Error = FALSE;
+    typeCheck(ctx, u->ast);
+    u->checks = ctx->listing;
+    u->failed = ctx->Error;
+    ctx->listing = listing;
+    ctx->Error = FALSE;
+    return !u->checks.failed;
+}
+
+/* moved tells whether a name u uses has another
+   location than when its code was generated */
+static int moved(Program* p, Unit* u) {
+    int i;
+    for (i = 0; i < u->nuses; i++)
+        if (st_lookup(&p->ctx.symtab, u->uses[i].name) != u->uses[i].loc)
+            return TRUE;
+    return FALSE;
+}
+
+/* genUnit generates the code of u from location 0,
+   keeping the locations of the names it uses */
+static int genUnit(Program* p, Unit* u) {
+    Compiler* ctx = &p->ctx;
+    Output code = ctx->code;
+    int i;
+    outRelease(&u->code);
+    ctx->code = u->code;
+    ctx->emitLoc = ctx->highEmitLoc = ctx->tmpOffset = 0;
+    codeGenTree(ctx, u->ast, u->ast->root);
+    u->code = ctx->code;
+    u->size = ctx->highEmitLoc;
+    ctx->code = code;
+    for (i = 0; i < u->nuses; i++)
+        u->uses[i].loc = st_lookup(&ctx->symtab, u->uses[i].name);
+    u->coded = !u->code.failed;
+    return u->coded;
+}
+
+/* finish analyzes and generates code for the units
+   of p that need it, units first..last-1 being new
+   and, if renamed, the locations of the names being
+   possibly moved, then puts the listing and the code
+   of the whole program in result */
+static int finish(Program* p, int first, int last, int renamed,
+                  TinyResult* result) {
+    Compiler* ctx = &p->ctx;
+    const TinyOptions* o = &p->options;
+    Output listing = {0};
+    int failed = FALSE, ok = TRUE, i, j;
+    double t = now();
+    if (p->name != NULL)
+        outPrintf(&listing, "\nTINY COMPILATION: %s\n", p->name);
+    if (o->TraceParse) {
+        outPrintf(&listing, "\nSyntax tree:\n");
+        for (i = 0; i < p->count; i++)
+            outWrite(&listing, p->units[i].tree.text, p->units[i].tree.length);
+    }
+    if (!o->noAnalyze) {
+        /* the symbol table is entered again from the
+           names of the units, in order, when it may
+           have changed (or is listed) */
+        if (renamed || o->TraceAnalyze) {
+            freeSymTab(&ctx->symtab);
+            ctx->location = 0;
+            for (i = 0; i < p->count; i++) {
+                Unit* u = &p->units[i];
+                int line = p->tokens.line[u->first];
+                for (j = 0; j < u->nuses; j++) {
+                    XRef ref = u->uses[j].ref;
+                    ref.lineno += line;
+                    enterSymbol(ctx, u->uses[j].name, &ref);
+                }
+            }
+        }
+        if (o->TraceAnalyze) {
+            outPrintf(&listing, "\nBuilding Symbol Table...\n");
+            outPrintf(&listing, "\nSymbol table:\n\n");
+            printSymTab(&ctx->symtab, &listing);
+            outPrintf(&listing, "\nChecking Types...\n");
+        }
+        /* a unit with errors is checked again when its
+           lines move, for the line numbers */
+        for (i = 0; i < p->count; i++) {
+            Unit* u = &p->units[i];
+            if ((i >= first && i < last) ||
+                (u->failed && u->line != p->tokens.line[u->first]))
+                ok = checkUnit(p, u) && ok;
+            outWrite(&listing, u->checks.text, u->checks.length);
+            failed |= u->failed;
+        }
+        if (o->TraceAnalyze)
+            outPrintf(&listing, "\nType Checking Finished\n");
+        result->seconds[TINY_ANALYZE] = now() - t;
+        t += result->seconds[TINY_ANALYZE];
+        if (!o->noCode && !failed) {
+            for (i = 0; i < p->count; i++) {
+                Unit* u = &p->units[i];
+                if (!u->coded || (renamed && moved(p, u)))
+                    ok = genUnit(p, u) && ok;
+            }
+            ctx->emitLoc = ctx->highEmitLoc = ctx->tmpOffset = 0;
+            codeGenStart(ctx, p->codefile);
+            for (i = 0; i < p->count; i++)
+                emitCode(ctx, p->units[i].code.text, p->units[i].code.length,
+                         p->units[i].size);
+            codeGenEnd(ctx);
+            result->seconds[TINY_CODE] = now() - t;
+        }
+    }
+    ok = ok && !listing.failed && !ctx->code.failed;
+    result->listing = listing.text;
+    result->listingLength = listing.length;
+    result->code = ctx->code.text;
+    result->codeLength = ctx->code.length;
+    result->Error = failed;
+    /* the code buffer now belongs to result */
+    ctx->code.text = NULL;
+    outRelease(&ctx->code);
+    return ok;
+}
+
+/* compileAll compiles the whole source of p, into
+   units unless the scan is traced or the source has
+   errors; in those cases p is kept whole, and the
+   source is compiled by tinyCompile */
+static int compileAll(Program* p, TinyResult* result) {
+    Compiler* ctx = &p->ctx;
+    const TinyOptions* o = &p->options;
+    int threads = o->threads > 0 ? o->threads : 1, count, resume;
+    Unit* units;
+    double t = now();
+    freeUnits(p);
+    freeTokens(&p->tokens);
+    freeSymTab(&ctx->symtab);
+    freeAtoms(&ctx->atoms);
+    outRelease(&ctx->listing);
+    ctx->Error = FALSE;
+    memset(result->seconds, 0, sizeof(result->seconds));
+    if (!o->noParse && !o->EchoSource && !o->TraceScan &&
+        tokenizeParallel(ctx, &p->tokens, threads) && !ctx->Error) {
+        result->seconds[TINY_SCAN] = now() - t;
+        t += result->seconds[TINY_SCAN];
+        if (parseUnits(p, 0, NULL, &units, &count, &resume)) {
+            p->units = units;
+            p->count = count;
+            result->seconds[TINY_PARSE] = now() - t;
+            return finish(p, 0, count, TRUE, result);
+        }
+    }
+    freeTokens(&p->tokens);
+    outRelease(&ctx->listing);
+    return tinyCompile(p->text, p->length, o, result);
+}
+
+/* Function openProgram compiles the length bytes
+ * of source text into result as tinyCompile does,
+ * and returns the program, to be edited with
+ * editProgram; options (which may be NULL) hold for
+ * every edit. It returns NULL when out of memory,
+ * result being then empty
+ */
+Program* openProgram(const char* text, int length, const TinyOptions* options,
+                     TinyResult* result) {
+    static const TinyOptions defaults = {0};
+    Program* p = calloc(1, sizeof(Program));
+    memset(result, 0, sizeof(*result));
+    if (p == NULL) return NULL;
+    if (options == NULL) options = &defaults;
+    initCompiler(&p->ctx, NULL, NULL);
+    p->ctx.EchoSource = options->EchoSource;
+    p->ctx.TraceScan = options->TraceScan;
+    p->ctx.TraceParse = options->TraceParse;
+    p->ctx.TraceAnalyze = options->TraceAnalyze;
+    p->ctx.TraceCode = options->TraceCode;
+    p->options = *options;
+    if (options->name != NULL &&
+        (p->name = malloc(strlen(options->name) + 1)) != NULL)
+        strcpy(p->name, options->name);
+    p->options.name = p->name;
+    p->codefile = outputName(p->name ? p->name : "", ".tm");
+    if ((p->text = malloc(length + 1)) != NULL) {
+        if (length > 0) memcpy(p->text, text, length);
+        p->text[length] = '\0';
+        p->length = length;
+    }
+    if ((options->name != NULL && p->name == NULL) || p->codefile == NULL ||
+        p->text == NULL) {
+        closeProgram(p);
+        return NULL;
+    }
+    useSource(&p->ctx, p->text, p->length);
+    if (!compileAll(p, result)) {
+        tinyFree(result);
+        closeProgram(p);
+        return NULL;
+    }
+    return p;
+}
+
+/* Function editProgram replaces the removed bytes
+ * at offset in the source of p by the inserted
+ * bytes at text, and compiles the new source into
+ * result, which is what tinyCompile would give for
+ * it. Only the units whose tokens the edit changed
+ * are parsed, checked and generated again, and the
+ * code of the others is moved into place. The whole
+ * source is compiled again when it has errors
+ * (before or after the edit) or when the scan is
+ * traced. It returns FALSE when out of memory or if
+ * the edit is not within the source, result being
+ * then incomplete
+ */
+int editProgram(Program* p, int offset, int removed, const char* text,
+                int inserted, TinyResult* result) {
+    Compiler* ctx = &p->ctx;
+    TokenEdit edit;
+    Unit* fresh;
+    Unit* units;
+    char* source;
+    int length, nfresh, a, b, to, tail, renamed, i;
+    double t = now();
+    memset(result, 0, sizeof(*result));
+    if (offset < 0 || removed < 0 || inserted < 0 ||
+        offset > p->length - removed)
+        return FALSE;
+    length = p->length - removed + inserted;
+    if ((source = malloc(length + 1)) == NULL) return FALSE;
+    memcpy(source, p->text, offset);
+    if (inserted > 0) memcpy(source + offset, text, inserted);
+    memcpy(source + offset + inserted, p->text + offset + removed,
+           p->length - offset - removed);
+    source[length] = '\0';
+    free(p->text);
+    p->text = source;
+    p->length = length;
+    useSource(ctx, p->text, p->length);
+    if (p->count == 0) return compileAll(p, result);
+    outRelease(&ctx->listing);
+    ctx->Error = FALSE;
+    if (!relexTokens(ctx, &p->tokens, p->text, p->length, offset, removed,
+                     inserted, &edit) ||
+        ctx->Error)
+        return compileAll(p, result);
+    result->seconds[TINY_SCAN] = now() - t;
+    t += result->seconds[TINY_SCAN];
+    /* units a..b-1 give way to the fresh ones; the
+       units before a did not read a changed token */
+    a = findUnit(p, edit.first);
+    if (!parseUnits(p, p->units[a].first, &edit, &fresh, &nfresh, &b))
+        return compileAll(p, result);
+    renamed = !sameNames(p->units + a, b - a, fresh, nfresh);
+    to = a + nfresh;
+    tail = p->count - b;
+    if (to + tail > p->count) {
+        units = realloc(p->units, (to + tail) * sizeof(Unit));
+        if (units == NULL) {
+            for (i = 0; i < nfresh; i++) freeUnit(&fresh[i]);
+            free(fresh);
+            return compileAll(p, result);
+        }
+        p->units = units;
+    }
+    for (i = a; i < b; i++) freeUnit(&p->units[i]);
+    memmove(p->units + to, p->units + b, tail * sizeof(Unit));
+    memcpy(p->units + a, fresh, nfresh * sizeof(Unit));
+    free(fresh);
+    for (i = to; i < to + tail; i++)
+        p->units[i].first += edit.last - edit.oldLast;
+    p->count = to + tail;
+    result->seconds[TINY_PARSE] = now() - t;
+    return finish(p, a, to, renamed, result);
+}
+
+/* Procedure closeProgram releases p */
+void closeProgram(Program* p) {
+    if (p == NULL) return;
+    freeUnits(p);
+    freeTokens(&p->tokens);
+    freeCompiler(&p->ctx);
+    free(p->text);
+    free(p->name);
+    free(p->codefile);
+    free(p);
+}
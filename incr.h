@@ -0,0 +1,48 @@
+/****************************************************/
+/* File: incr.h                                     */
+/* Incremental recompilation: a program kept in     */
+/* memory between edits and compiled again one      */
+/* top-level statement at a time                    */
+/****************************************************/
+
+#ifndef _INCR_H_
+#define _INCR_H_
+#include "tiny.h"
+
+/* Program is a source program kept between edits,
+ * with the tree, the type checks and the code of
+ * each of its top-level statements (its units: a
+ * function, a declaration or any other statement)
+ */
+typedef struct Program Program;
+
+/* Function openProgram compiles the length bytes
+ * of source text into result as tinyCompile does,
+ * and returns the program, to be edited with
+ * editProgram; options (which may be NULL) hold for
+ * every edit. It returns NULL when out of memory,
+ * result being then empty
+ */
+Program* openProgram(const char* text, int length, const TinyOptions* options,
+                     TinyResult* result);
+
+/* Function editProgram replaces the removed bytes
+ * at offset in the source of p by the inserted
+ * bytes at text, and compiles the new source into
+ * result, which is what tinyCompile would give for
+ * it. Only the units whose tokens the edit changed
+ * are parsed, checked and generated again, and the
+ * code of the others is moved into place. The whole
+ * source is compiled again when it has errors
+ * (before or after the edit) or when the scan is
+ * traced. It returns FALSE when out of memory or if
+ * the edit is not within the source, result being
+ * then incomplete
+ */
+int editProgram(Program* p, int offset, int removed, const char* text,
+                int inserted, TinyResult* result);
+
+/* Procedure closeProgram releases p */
+void closeProgram(Program* p);
+
+#endif
@@ -19,10 +19,20 @@
  */
 #define NO_CODE FALSE
 
-#include "util.h"
-#if NO_PARSE
+/* set FUSE_ANALYSIS to TRUE to analyze the program
+ * while it is parsed, in one pass over the source
+ */
+#define FUSE_ANALYSIS FALSE
+
+#include "batch.h"
+#include "cache.h"
+#include "compiler.h"
+#include "pgen.h"
+#include "plex.h"
 #include "scan.h"
-#else
+#include "server.h"
+#include "util.h"
+#if !NO_PARSE
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
@@ -32,35 +42,173 @@
 #endif
 #endif
 
-/* allocate global variables */
-int lineno = 0;
-FILE* source;
-FILE* listing;
-FILE* code;
+/* tracing flags, copied into the compiler context */
+// static int EchoSource = FALSE;
+// static int TraceScan = FALSE;
+static int EchoSource = TRUE;
+static int TraceScan = TRUE;
+
+static int TraceParse = TRUE;
+static int TraceAnalyze = FALSE;
+static int TraceCode = FALSE;
 
-/* allocate and set tracing flags */
-// int EchoSource = FALSE;
-// int TraceScan = FALSE;
-int EchoSource = TRUE;
-int TraceScan = TRUE;
+/* settings sets options to the settings above */
+static void settings(TinyOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->noParse = NO_PARSE;
+    options->noAnalyze = NO_ANALYZE;
+    options->noCode = NO_CODE;
+    options->fuseAnalysis = FUSE_ANALYSIS;
+    options->EchoSource = EchoSource;
+    options->TraceScan = TraceScan;
+    options->TraceParse = TraceParse;
+    options->TraceAnalyze = TraceAnalyze;
+    options->TraceCode = TraceCode;
+}
 
-int TraceParse = TRUE;
-int TraceAnalyze = FALSE;
-int TraceCode = FALSE;
+/* cachedMain compiles the file pgm through cache
+   with the settings above, printing the listing
+   and writing the code file as main does */
+static int cachedMain(Cache* cache, char* pgm) {
+    TinyOptions options;
+    TinyResult result;
+    int length, ok;
+    char* text = readFile(pgm, &length);
+    if (text == NULL) {
+        fprintf(stderr, "File %s not found\n", pgm);
+        exit(1);
+    }
+    settings(&options);
+    options.name = pgm;
+    ok = cacheCompile(cache, text, length, &options, &result);
+    if (result.listing != NULL)
+        fwrite(result.listing, 1, result.listingLength, stdout);
+    if (result.code != NULL) {
+        char* codefile = outputName(pgm, ".tm");
+        FILE* code = codefile ? fopen(codefile, "w") : NULL;
+        if (code == NULL) {
+            printf("Unable to open %s\n", codefile ? codefile : pgm);
+            exit(1);
+        }
+        fwrite(result.code, 1, result.codeLength, code);
+        fclose(code);
+        free(codefile);
+    }
+    tinyFree(&result);
+    free(text);
+    cacheClose(cache);
+    return !ok;
+}
 
-int Error = FALSE;
+/* batchMain compiles many files, named on the command
+   line or listed in @manifest files, on a pool of
+   threads (-j, 0 or none: one per processor) with
+   the settings above */
+static int batchMain(int argc, char* argv[], Cache* cache) {
+    TinyOptions options;
+    char** names = NULL;
+    int count = 0, nthreads = 0, failed, i;
+    settings(&options);
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            nthreads = atoi(argv[++i]);
+        else if (argv[i][0] == '@') {
+            if (!readManifest(argv[i] + 1, &names, &count)) {
+                fprintf(stderr, "Manifest %s not read\n", argv[i] + 1);
+                exit(1);
+            }
+        } else if (!batchAdd(&names, &count, argv[i], strlen(argv[i]))) {
+            fprintf(stderr, "Out of memory error in batch\n");
+            exit(1);
+        }
+    }
+    failed = compileBatch(names, count, &options, nthreads, cache);
+    if (cache != NULL) cacheClose(cache);
+    for (i = 0; i < count; i++) free(names[i]);
+    free(names);
+    return failed > 0;
+}
 
 int main(int argc, char* argv[]) {
-    TreeNode* syntaxTree;
-    char pgm[120]; /* source code file name */
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+    Compiler compiler;
+    FILE* source;
+    FILE* listing;
+    Ast* syntaxTree = NULL;
+    TokenStream tokens = {0};
+    char* pgm; /* source code file name */
+    char* base;
+    int nthreads = 1; /* threads lexing, checking and coding, -j option
+                         (0: all) */
+    int arg = 1;
+    int saveTree = FALSE; /* -a option */
+    int mapped; /* the file is a saved syntax tree */
+    Cache cache;
+    Cache* cached = NULL; /* -c option */
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        if (!cacheOpen(&cache, argv[2], CACHELIMIT)) {
+            fprintf(stderr, "Cache %s cannot be used\n", argv[2]);
+            exit(1);
+        }
+        cached = &cache;
+        /* the rest of the command as if -c were not there */
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 1 && strcmp(argv[1], "-b") == 0)
+        return batchMain(argc - 2, argv + 2, cached);
+    if (argc > 2 && strcmp(argv[1], "-s") == 0 &&
+        (argc == 3 || (argc == 5 && strcmp(argv[2], "-j") == 0))) {
+        /* compile server, -j connections served at once */
+        int ok = runServer(argv[argc - 1], argc == 5 ? atoi(argv[3]) : 0,
+                           cached);
+        if (cached != NULL) cacheClose(cached);
+        return !ok;
+    }
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        saveTree = TRUE;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    if (argc == 4 && strcmp(argv[1], "-j") == 0) {
+        nthreads = atoi(argv[2]);
+        arg = 3;
+    }
+    if (argc != arg + 1) {
+        fprintf(stderr,
+                "usage: %s [-c cachedir] [-a] [-j threads] "
+                "<filename | filename.ast>\n",
+                argv[0]);
+        fprintf(stderr,
+                "       %s [-c cachedir] -b [-j threads] "
+                "{<filename> | @manifest}...\n",
+                argv[0]);
+        fprintf(stderr,
+                "       %s [-c cachedir] -s [-j connections] <socket | ->\n",
+                argv[0]);
         exit(1);
     }
-    strcpy(pgm, argv[1]);
-    if (strchr(pgm, '.') == NULL) strcat(pgm, ".tny");
-    source = fopen(pgm, "r");
-    if (source == NULL) {
+    /* .tny is added to a name without an extension */
+    base = strrchr(argv[arg], '/');
+    pgm = strchr(base ? base : argv[arg], '.') ? argv[arg]
+                                               : outputName(argv[arg], ".tny");
+    if (pgm == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    mapped = strlen(pgm) > 4 && strcmp(pgm + strlen(pgm) - 4, ".ast") == 0;
+    if (mapped && saveTree) {
+        fprintf(stderr, "%s is a syntax tree already\n", pgm);
+        exit(1);
+    }
+    if (cached != NULL) {
+        if (!mapped && !saveTree) return cachedMain(cached, pgm);
+        /* the tree is not in the cache: compiled without it */
+        cacheClose(cached);
+    }
+    source = mapped ? NULL : fopen(pgm, "r");
+    if (!mapped && source == NULL) {
         fprintf(stderr, "File %s not found\n", pgm);
         exit(1);
     }
@@ -70,42 +218,82 @@ int main(int argc, char* argv[]) {
         printf("Error\n");
         return 0;
     }
+    initCompiler(&compiler, source, listing);
+    compiler.EchoSource = EchoSource;
+    compiler.TraceScan = TraceScan;
+    compiler.TraceParse = TraceParse;
+    compiler.TraceAnalyze = TraceAnalyze;
+    compiler.TraceCode = TraceCode;
+    /* a mapped tree is not parsed, so it is analyzed
+       apart */
+    compiler.fuseAnalysis = FUSE_ANALYSIS && !NO_ANALYZE && !mapped;
     fprintf(listing, "\nTINY COMPILATION: %s\n", pgm);
-#if NO_PARSE
-    while (getToken() != ENDFILE)
-        ;
-#else
-    syntaxTree = parse();
+    if (!mapped && !tokenizeParallel(&compiler, &tokens, nthreads)) exit(1);
+#if !NO_PARSE
+    if (mapped) {
+        /* a saved tree, walked in place: no scanning
+           or parsing */
+        syntaxTree = astMap(pgm);
+        if (syntaxTree == NULL) {
+            fprintf(stderr, "Syntax tree %s cannot be mapped\n", pgm);
+            exit(1);
+        }
+    } else {
+        /* lay the parsed tree out compactly; names are
+           interned, so the parser's arena can go at once */
+        syntaxTree = buildAst(&compiler.atoms, parse(&compiler, &tokens));
+        arenaRelease(&compiler.arena);
+        if (syntaxTree == NULL) {
+            fprintf(listing, "Out of memory error at line %d\n",
+                    compiler.lineno);
+            exit(1);
+        }
+    }
     if (TraceParse) {
         fprintf(listing, "\nSyntax tree:\n");
-        printTree(syntaxTree);
+        printTree(&compiler.listing, syntaxTree, syntaxTree->root);
+    }
+    /* only a tree without syntax errors is saved, as
+       the phases after parsing expect one */
+    if (saveTree && !compiler.Error) {
+        char* treefile = outputName(pgm, ".ast");
+        if (treefile == NULL || !astSave(syntaxTree, treefile)) {
+            printf("Unable to write %s\n", treefile ? treefile : pgm);
+            exit(1);
+        }
+        free(treefile);
     }
 #if !NO_ANALYZE
-    if (!Error) {
+    if (!compiler.Error) {
         if (TraceAnalyze) fprintf(listing, "\nBuilding Symbol Table...\n");
-        buildSymtab(syntaxTree);
+        if (compiler.fuseAnalysis)
+            buildSymtabFused(&compiler);
+        else
+            buildSymtab(&compiler, syntaxTree);
         if (TraceAnalyze) fprintf(listing, "\nChecking Types...\n");
-        typeCheck(syntaxTree);
+        if (compiler.fuseAnalysis)
+            typeCheckFused(&compiler);
+        else
+            typeCheckParallel(&compiler, syntaxTree, nthreads);
         if (TraceAnalyze) fprintf(listing, "\nType Checking Finished\n");
     }
 #if !NO_CODE
-    if (!Error) {
-        char* codefile;
-        int fnlen = strcspn(pgm, ".");
-        codefile = (char*)calloc(fnlen + 4, sizeof(char));
-        strncpy(codefile, pgm, fnlen);
-        strcat(codefile, ".tm");
-        code = fopen(codefile, "w");
-        if (code == NULL) {
-            printf("Unable to open %s\n", codefile);
+    if (!compiler.Error) {
+        char* codefile = outputName(pgm, ".tm");
+        compiler.code.file = codefile ? fopen(codefile, "w") : NULL;
+        if (compiler.code.file == NULL) {
+            printf("Unable to open %s\n", codefile ? codefile : pgm);
             exit(1);
         }
-        codeGen(syntaxTree, codefile);
-        fclose(code);
+        codeGenParallel(&compiler, syntaxTree, codefile, nthreads);
+        fclose(compiler.code.file);
     }
 #endif
 #endif
 #endif
-    fclose(source);
+    freeAst(syntaxTree);
+    freeTokens(&tokens);
+    freeCompiler(&compiler);
+    if (source != NULL) fclose(source);
     return 0;
 }
@@ -0,0 +1,74 @@
+/****************************************************/
+/* File: output.c                                   */
+/* Listing and code output of one compilation:      */
+/* written to a stdio stream, or kept in memory     */
+/****************************************************/
+
+#include "output.h"
+
+#include <stdarg.h>
+
+/* initial size of a memory buffer */
+#define INITIALSIZE 4096
+
+/* reserve makes room in the text of out for n more
+   bytes and the terminating null; it returns FALSE,
+   and marks out as failed, when out of memory */
+static int reserve(Output* out, int n) {
+    int cap = out->capacity ? out->capacity : INITIALSIZE;
+    char* text;
+    if (out->failed) return FALSE;
+    if (out->length + n < out->capacity) return TRUE;
+    while (out->length + n >= cap) cap *= 2;
+    text = realloc(out->text, cap);
+    if (text == NULL) {
+        out->failed = TRUE;
+        return FALSE;
+    }
+    out->text = text;
+    out->capacity = cap;
+    return TRUE;
+}
+
+/* Procedure outPrintf writes to out as fprintf does */
+void outPrintf(Output* out, const char* format, ...) {
+    va_list ap, again;
+    int n;
+    va_start(ap, format);
+    if (out->file != NULL)
+        vfprintf(out->file, format, ap);
+    else if (reserve(out, 0)) {
+        va_copy(again, ap);
+        n = vsnprintf(out->text + out->length, out->capacity - out->length,
+                      format, ap);
+        if (n >= out->capacity - out->length && reserve(out, n))
+            vsnprintf(out->text + out->length, out->capacity - out->length,
+                      format, again);
+        if (n > 0 && !out->failed) out->length += n;
+        out->text[out->length] = '\0';
+        va_end(again);
+    }
+    va_end(ap);
+}
+
+/* Procedure outWrite writes the n bytes at s to out */
+void outWrite(Output* out, const char* s, int n) {
+    if (n <= 0) return;
+    if (out->file != NULL)
+        fwrite(s, 1, n, out->file);
+    else if (reserve(out, n)) {
+        memcpy(out->text + out->length, s, n);
+        out->length += n;
+        out->text[out->length] = '\0';
+    }
+}
+
+/* Procedure outRelease frees the buffered text
+ * of out, which is left empty
+ */
+void outRelease(Output* out) {
+    free(out->text);
+    out->text = NULL;
+    out->length = out->capacity = 0;
+    out->failed = FALSE;
+}
@@ -0,0 +1,35 @@
+/****************************************************/
+/* File: output.h                                   */
+/* Listing and code output of one compilation:      */
+/* written to a stdio stream, or kept in memory     */
+/****************************************************/
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+#include "globals.h"
+
+/* Output receives the listing or the TM code of a
+ * compilation: it writes through to file, or, when
+ * file is NULL, appends to the growable null-terminated
+ * text; a zeroed Output is an empty memory buffer
+ */
+typedef struct {
+    FILE* file;
+    char* text;
+    int length;
+    int capacity;
+    int failed; /* text was cut short by lack of memory */
+} Output;
+
+/* Procedure outPrintf writes to out as fprintf does */
+void outPrintf(Output* out, const char* format, ...);
+
+/* Procedure outWrite writes the n bytes at s to out */
+void outWrite(Output* out, const char* s, int n);
+
+/* Procedure outRelease frees the buffered text
+ * of out, which is left empty
+ */
+void outRelease(Output* out);
+
+#endif
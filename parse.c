@@ -8,75 +8,164 @@
 // #include "globals.h"
 #include "parse.h"
 
+#include "analyze.h"
+#include "arena.h"
+#include "atom.h"
+#include "compiler.h"
 #include "scan.h"
 #include "util.h"
 
-static TokenType token; /* holds current token */
-
 /* function prototypes for recursive calls */
-static TreeNode* stmt_sequence(void);
-static TreeNode* statement(void);
-static TreeNode* if_stmt(void);
-static TreeNode* repeat_stmt(void);
-static TreeNode* assign_stmt(void);
-static TreeNode* read_stmt(void);
-static TreeNode* write_stmt(void);
-static TreeNode* expp(void);
-static TreeNode* simple_exp(void);
-static TreeNode* term(void);
-static TreeNode* factor(void);
+static TreeNode* stmt_sequence(Compiler* ctx);
+static TreeNode* statement(Compiler* ctx);
+static TreeNode* if_stmt(Compiler* ctx);
+static TreeNode* repeat_stmt(Compiler* ctx);
+static TreeNode* assign_stmt(Compiler* ctx);
+static TreeNode* read_stmt(Compiler* ctx);
+static TreeNode* write_stmt(Compiler* ctx);
+static TreeNode* expp(Compiler* ctx);
+static TreeNode* factor(Compiler* ctx);
 /* 添加变量声明语句，含一维数组 */
-static TreeNode* declare_stmt(void);  // 变量声明
-static TreeNode* type(void);          // 变量类型，只有int
-static void kind(TreeNode* t);
-static TreeNode* id_lists(void);  // 变量列表
-static TreeNode* id_list(TreeNode* p);
-static TreeNode* dec_tmp1(void);
-static void arr_de(TreeNode* t);
+static TreeNode* declare_stmt(Compiler* ctx);  // 变量声明
+static TreeNode* type(Compiler* ctx);          // 变量类型，只有int
+static void kind(Compiler* ctx, TreeNode* t);
+static TreeNode* id_lists(Compiler* ctx);  // 变量列表
+static TreeNode* id_list(Compiler* ctx, TreeNode* p);
+static TreeNode* dec_tmp1(Compiler* ctx);
+static void arr_de(Compiler* ctx, TreeNode* t);
 /* 添加函数声明语句 */
-static TreeNode* function_stmt(void);  // 函数声明
-static TreeNode* para_lists(void);     // 参数列表
-static TreeNode* para_list(void);
-static TreeNode* body(void);  // 函数体
+static TreeNode* function_stmt(Compiler* ctx);  // 函数声明
+static TreeNode* para_lists(Compiler* ctx);     // 参数列表
+static TreeNode* para_list(Compiler* ctx);
+static TreeNode* body(Compiler* ctx);  // 函数体
 
-static TreeNode* return_stmt(void);  // return语句
+static TreeNode* return_stmt(Compiler* ctx);  // return语句
 /* 添加函数调用 */
-static TreeNode* X(TreeNode* p);
-static void Q(TreeNode* t);
-static void QQ(TreeNode* t);
+static TreeNode* X(Compiler* ctx, TreeNode* p);
+static void Q(Compiler* ctx, TreeNode* t);
+static void QQ(Compiler* ctx, TreeNode* t);
 /* 关于数组与函数的引用 */
-static TreeNode* infactor(void);
-static void params(TreeNode* t);
-static TreeNode* inparams(void);
-static TreeNode* inparam(void);
-static void inpara(TreeNode* t);
+static TreeNode* infactor(Compiler* ctx);
+static void params(Compiler* ctx, TreeNode* t);
+static TreeNode* inparams(Compiler* ctx);
+static TreeNode* inparam(Compiler* ctx);
+static void inpara(Compiler* ctx, TreeNode* t);
 /* while 和 dowhile语句 */
-static TreeNode* while_stmt(void);
+static TreeNode* while_stmt(Compiler* ctx);
+
+/* binaryOps gives each binary operator token its
+   precedence (0 for tokens that are not binary
+   operators); an entry here is all the grammar needs
+   for a new operator */
+static const struct {
+    unsigned char prec;     /* higher binds tighter */
+    unsigned char nonassoc; /* a < b < c is not an expression */
+} binaryOps[FLOAT + 1] = {
+    [EQ] = {1, TRUE},    [LT] = {1, TRUE},     /* comparison */
+    [PLUS] = {2, FALSE}, [MINUS] = {2, FALSE}, /* additive */
+    [TIMES] = {3, FALSE}, [OVER] = {3, FALSE}, /* multiplicative */
+};
+
+static void syntaxError(Compiler* ctx, char* message) {
+    outPrintf(&ctx->listing, "\n>>> ");
+    outPrintf(&ctx->listing, "Syntax error at line %d: %s", ctx->lineno,
+              message);
+    ctx->Error = TRUE;
+}
+
+/* nextToken moves on to the next token of the
+   stream; the ENDFILE token at the end is kept. The
+   start of a line is looked for once, at its first
+   token, for the columns of its tokens */
+static void nextToken(Compiler* ctx) {
+    int start, line;
+    if (ctx->tokenIndex < ctx->tokens->count - 1) ctx->tokenIndex++;
+    ctx->token = (TokenType)ctx->tokens->kind[ctx->tokenIndex];
+    line = ctx->tokens->line[ctx->tokenIndex];
+    start = ctx->tokens->start[ctx->tokenIndex];
+    if (ctx->lineStart < 0 || line != ctx->lineno) {
+        ctx->lineStart = start;
+        while (ctx->lineStart > 0 &&
+               ctx->sourceText[ctx->lineStart - 1] != '\n')
+            ctx->lineStart--;
+    }
+    ctx->lineno = line;
+    ctx->column = start - ctx->lineStart + 1;
+}
+
+/* tokenText returns the lexeme of the current token:
+   the interned name of an ID, a copy in the arena
+   otherwise */
+static char* tokenText(Compiler* ctx) {
+    char* s;
+    int i = ctx->tokenIndex;
+    if (ctx->token == ID) return atomName(&ctx->atoms, ctx->tokens->value[i]);
+    s = arenaString(&ctx->arena, ctx->sourceText + ctx->tokens->start[i],
+                    ctx->tokens->length[i]);
+    if (s == NULL)
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
+    return s;
+}
+
+/* newArray allocates n elements of the given size in
+   the arena for an attribute array of a node */
+static void* newArray(Compiler* ctx, int n, size_t size) {
+    void* a = arenaAlloc(&ctx->arena, n * size);
+    if (a == NULL)
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
+    return a;
+}
+
+/* lexeme returns the lexeme of the current token
+   (at most MAXTOKENLEN characters) for messages, in
+   the tokenString of ctx */
+static const char* lexeme(Compiler* ctx) {
+    char* buf = ctx->tokenString;
+    int n = ctx->tokens->length[ctx->tokenIndex];
+    if (n > MAXTOKENLEN) n = MAXTOKENLEN;
+    memcpy(buf, ctx->sourceText + ctx->tokens->start[ctx->tokenIndex], n);
+    buf[n] = '\0';
+    return buf;
+}
+
+/* with the analysis fused with parsing (see
+   analyze.h), checked type checks the finished node
+   t, and returns it; referenced enters the reference
+   of kind kind that t makes to its name, and declared
+   declares the parameter or local t */
+static TreeNode* checked(Compiler* ctx, TreeNode* t) {
+    if (ctx->fuseAnalysis && t != NULL) fuseCheck(ctx, t);
+    return t;
+}
+
+static void referenced(Compiler* ctx, TreeNode* t, RefKind kind) {
+    if (ctx->fuseAnalysis && t != NULL) fuseReference(ctx, t, kind);
+}
 
-static void syntaxError(char* message) {
-    fprintf(listing, "\n>>> ");
-    fprintf(listing, "Syntax error at line %d: %s", lineno, message);
-    Error = TRUE;
+static void declared(Compiler* ctx, TreeNode* t) {
+    if (ctx->fuseAnalysis && t != NULL) fuseDeclare(ctx, t);
 }
 
-static void match(TokenType expected) {
-    if (token == expected)
-        token = getToken();
+static void match(Compiler* ctx, TokenType expected) {
+    if (ctx->token == expected)
+        nextToken(ctx);
     else {
-        syntaxError("unexpected token -> ");
-        printToken(token, tokenString);
-        fprintf(listing, "      ");
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(&ctx->listing, ctx->token, lexeme(ctx));
+        outPrintf(&ctx->listing, "      ");
     }
 }
 
-TreeNode* stmt_sequence(void) {
-    TreeNode* t = statement();
+TreeNode* stmt_sequence(Compiler* ctx) {
+    TreeNode* t = statement(ctx);
     TreeNode* p = t;
-    while ((token != ENDFILE) && (token != END) && (token != ELSE) &&
-           (token != UNTIL)) {
+    while ((ctx->token != ENDFILE) && (ctx->token != END) &&
+           (ctx->token != ELSE) && (ctx->token != UNTIL)) {
         TreeNode* q;
-        match(SEMI);
-        q = statement();
+        match(ctx, SEMI);
+        q = statement(ctx);
         if (q != NULL) {
             if (t == NULL)
                 t = p = q;
@@ -91,439 +180,474 @@ TreeNode* stmt_sequence(void) {
 }
 
 /* 添加变量声明 */
-TreeNode* statement(void) {
+TreeNode* statement(Compiler* ctx) {
     TreeNode* t = NULL;
-    switch (token) {
+    switch (ctx->token) {
         case IF:
-            t = if_stmt();
+            t = if_stmt(ctx);
             break;
         case REPEAT:
-            t = repeat_stmt();
+            t = repeat_stmt(ctx);
             break;
         case ID:
-            t = assign_stmt();
+            t = assign_stmt(ctx);
             break;
         case READ:
-            t = read_stmt();
+            t = read_stmt(ctx);
             break;
         case WRITE:
-            t = write_stmt();
+            t = write_stmt(ctx);
             break;
         /* 变量声明语句 */
         case INT:
-            t = declare_stmt();
+            t = declare_stmt(ctx);
             break;
         /* 函数 */
         case FUNCTION:
-            t = function_stmt();
+            t = function_stmt(ctx);
             break;
         /* while语句 */
         case WHILE:
-            t = while_stmt();
+            t = while_stmt(ctx);
             break;
         /* return语句 */
         case RETURN:
-            t = return_stmt();
+            t = return_stmt(ctx);
             break;
         default:
-            syntaxError("unexpected token -> ");
-            printToken(token, tokenString);
-            token = getToken();
+            syntaxError(ctx, "unexpected token -> ");
+            printToken(&ctx->listing, ctx->token, lexeme(ctx));
+            nextToken(ctx);
             break;
     } /* end case */
     return t;
 }
 
-TreeNode* if_stmt(void) {
-    TreeNode* t = newStmtNode(IfK);
-    match(IF);
-    if (t != NULL) t->child[0] = expp();
-    match(THEN);
-    if (t != NULL) t->child[1] = stmt_sequence();
-    if (token == ELSE) {
-        match(ELSE);
-        if (t != NULL) t->child[2] = stmt_sequence();
+TreeNode* if_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, IfK);
+    match(ctx, IF);
+    if (t != NULL) t->child[0] = expp(ctx);
+    match(ctx, THEN);
+    if (t != NULL) t->child[1] = stmt_sequence(ctx);
+    if (ctx->token == ELSE) {
+        match(ctx, ELSE);
+        if (t != NULL) t->child[2] = stmt_sequence(ctx);
     }
-    match(END);
-    return t;
-}
-
-TreeNode* repeat_stmt(void) {
-    TreeNode* t = newStmtNode(RepeatK);
-    match(REPEAT);
-    if (t != NULL) t->child[0] = stmt_sequence();
-    match(UNTIL);
-    if (t != NULL) t->child[1] = expp();
-    return t;
+    match(ctx, END);
+    return checked(ctx, t);
 }
 
-TreeNode* assign_stmt(void) {
-    TreeNode* t = newStmtNode(AssignK);
-    if ((t != NULL) && (token == ID)) t->attr.name = copyString(tokenString);
-    match(ID);
-    match(ASSIGN);
-    if (t != NULL) t->child[0] = expp();
-    return t;
+TreeNode* repeat_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, RepeatK);
+    match(ctx, REPEAT);
+    if (t != NULL) t->child[0] = stmt_sequence(ctx);
+    match(ctx, UNTIL);
+    if (t != NULL) t->child[1] = expp(ctx);
+    return checked(ctx, t);
 }
 
-TreeNode* read_stmt(void) {
-    TreeNode* t = newStmtNode(ReadK);
-    match(READ);
-    if ((t != NULL) && (token == ID)) t->attr.name = copyString(tokenString);
-    match(ID);
+TreeNode* assign_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, AssignK);
+    if ((t != NULL) && (ctx->token == ID)) {
+        t->attr.name = tokenText(ctx);
+        referenced(ctx, t, DefR);
+    }
+    match(ctx, ID);
+    match(ctx, ASSIGN);
+    if (t != NULL) t->child[0] = expp(ctx);
+    return checked(ctx, t);
+}
+
+TreeNode* read_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, ReadK);
+    match(ctx, READ);
+    if ((t != NULL) && (ctx->token == ID)) {
+        t->attr.name = tokenText(ctx);
+        t->lineno = ctx->lineno; /* the name's, for its reference */
+        t->column = ctx->column;
+        referenced(ctx, t, DefR);
+    }
+    match(ctx, ID);
     return t;
 }
 
-TreeNode* write_stmt(void) {
-    TreeNode* t = newStmtNode(WriteK);
-    match(WRITE);
-    if (t != NULL) t->child[0] = expp();
-    return t;
+TreeNode* write_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, WriteK);
+    match(ctx, WRITE);
+    if (t != NULL) t->child[0] = expp(ctx);
+    return checked(ctx, t);
 }
 
 /* return 语句 */
-TreeNode* return_stmt(void) {
-    TreeNode* t = newStmtNode(ReturnK);
-    match(RETURN);
-    if (t != NULL) t->child[0] = expp();
+TreeNode* return_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, ReturnK);
+    match(ctx, RETURN);
+    if (t != NULL) t->child[0] = expp(ctx);
     return t;
 }
 
 // while 语句
-TreeNode* while_stmt(void) {
-    TreeNode* t = newStmtNode(WhileK);
-    match(WHILE);
-    if (t != NULL) t->child[0] = expp();
-    match(DO);
-    if (t != NULL) t->child[1] = stmt_sequence();
-    match(END);
+TreeNode* while_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, WhileK);
+    match(ctx, WHILE);
+    if (t != NULL) t->child[0] = expp(ctx);
+    match(ctx, DO);
+    if (t != NULL) t->child[1] = stmt_sequence(ctx);
+    match(ctx, END);
     return t;
 }
 
 /* 变量声明语句 */
-TreeNode* declare_stmt(void) {
-    TreeNode* t = newStmtNode(DeclareK);
+TreeNode* declare_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, DeclareK);
     if (t) {
-        t->child[0] = type();
-        t->child[1] = id_lists();
+        t->child[0] = type(ctx);
+        t->child[1] = id_lists(ctx);
     }
     return t;
 }
 
-TreeNode* id_lists(void) {
-    TreeNode* t = newStmtNode(IdListK);
-    if (token == ID) {
-        TreeNode* p = newExpNode(VarK);
-        if (p && token == ID) {
-            p->attr.name = copyString(tokenString);
+TreeNode* id_lists(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, IdListK);
+    if (ctx->token == ID) {
+        TreeNode* p = newExpNode(ctx, VarK);
+        if (p && ctx->token == ID) {
+            p->attr.name = tokenText(ctx);
+            p->column = ctx->column;
         }
-        match(ID);
-        p->sibling = id_list(p);
+        match(ctx, ID);
+        p->sibling = id_list(ctx, p);
         if (t) t->child[0] = p;
     }
     return t;
 }
 
-TreeNode* id_list(TreeNode* p) {
+TreeNode* id_list(Compiler* ctx, TreeNode* p) {
     TreeNode* t = NULL;
-    if (token == ASSIGN) {
+    if (ctx->token == ASSIGN) {
         p->kind.exp = VarInK;
-        match(token);
-        kind(p);
-        t = dec_tmp1();
+        match(ctx, ctx->token);
+        kind(ctx, p);
+        declared(ctx, p);
+        t = dec_tmp1(ctx);
     } else {
-        arr_de(p);
-        t = X(p);
+        /* initial values, if any, leave the size as it is */
+        arr_de(ctx, p);
+        declared(ctx, p);
+        t = X(ctx, p);
     }
     return t;
 }
 
-TreeNode* X(TreeNode* p) {
+TreeNode* X(Compiler* ctx, TreeNode* p) {
     TreeNode* t = NULL;
-    if (token == COMMA) {
-        t = dec_tmp1();
-    } else if (token == ASSIGN) {
-        match(token);
-        match(LSQU);
-        Q(p);
-        match(RSQU);
-        t = dec_tmp1();
+    if (ctx->token == COMMA) {
+        t = dec_tmp1(ctx);
+    } else if (ctx->token == ASSIGN) {
+        match(ctx, ctx->token);
+        match(ctx, LSQU);
+        Q(ctx, p);
+        match(ctx, RSQU);
+        t = dec_tmp1(ctx);
     }
     return t;
 }
 
-TreeNode* dec_tmp1(void) {
+TreeNode* dec_tmp1(Compiler* ctx) {
     TreeNode* t = NULL;
-    if (token == COMMA) {
-        t = newExpNode(VarK);
-        match(COMMA);
-        if (t && token == ID) {
-            t->attr.name = copyString(tokenString);
+    if (ctx->token == COMMA) {
+        t = newExpNode(ctx, VarK);
+        match(ctx, COMMA);
+        if (t && ctx->token == ID) {
+            t->attr.name = tokenText(ctx);
+            t->column = ctx->column;
         }
-        match(ID);
-        t->sibling = id_list(t);
+        match(ctx, ID);
+        t->sibling = id_list(ctx, t);
     }
     return t;
 }
 
-void arr_de(TreeNode* t) {
-    if (token == LSQU) {
-        t->kind.exp = ArrK;
-        match(token);
-        if (t && token == NUM) {
-            t->attr.dem[t->attr.pos++] = atoi(tokenString);
+/* the dimensions, initial values and subscripts of an
+   array are first counted ahead in the token stream,
+   so that the attribute array is allocated with its
+   exact size, and then filled as they are parsed.
+   countList counts, from token i on, the elements of
+   a list as the loops below parse it: each opened by
+   open, an element being a token elem or elem2, and
+   closed by close unless close is ENDFILE */
+static int countList(Compiler* ctx, int i, TokenType open, TokenType elem,
+                     TokenType elem2, TokenType close) {
+    const unsigned char* kind = ctx->tokens->kind;
+    int n = 0;
+    while (kind[i] == open) {
+        i++;
+        if (kind[i] == elem || kind[i] == elem2) {
+            n++;
+            i++;
         }
-        match(NUM);
-        match(RSQU);
-        arr_de(t);
+        if (close != ENDFILE && kind[i] == close) i++;
     }
+    return n;
 }
 
-void Q(TreeNode* t) {
-    if (token == NUM) {
+void arr_de(Compiler* ctx, TreeNode* t) {
+    int n = countList(ctx, ctx->tokenIndex, LSQU, NUM, NUM, RSQU);
+    if (n > 0) t->attr.dem = newArray(ctx, n, sizeof(int));
+    while (ctx->token == LSQU) {
+        t->kind.exp = ArrK;
+        match(ctx, ctx->token);
+        if (ctx->token == NUM && t->attr.dem)
+            t->attr.dem[t->attr.pos++] = ctx->tokens->value[ctx->tokenIndex];
+        match(ctx, NUM);
+        match(ctx, RSQU);
+    }
+}
+
+void Q(Compiler* ctx, TreeNode* t) {
+    int n;
+    if (ctx->token == NUM) {
         t->kind.exp = ArrInK;
-        if (t) t->attr.init_val[t->attr.ipos++] = atoi(tokenString);
-        match(token);
-        QQ(t);
+        n = 1 + countList(ctx, ctx->tokenIndex + 1, COMMA, NUM, NUM, ENDFILE);
+        if ((t->attr.init_val = newArray(ctx, n, sizeof(int))) != NULL)
+            t->attr.init_val[t->attr.ipos++] =
+                ctx->tokens->value[ctx->tokenIndex];
+        match(ctx, ctx->token);
+        QQ(ctx, t);
     }
 }
 
-void QQ(TreeNode* t) {
-    if (token == COMMA) {
-        match(token);
-        if (t && token == NUM) {
-            t->attr.init_val[t->attr.ipos++] = atoi(tokenString);
-        }
-        match(NUM);
-        QQ(t);
+void QQ(Compiler* ctx, TreeNode* t) {
+    while (ctx->token == COMMA) {
+        match(ctx, ctx->token);
+        if (ctx->token == NUM && t->attr.init_val)
+            t->attr.init_val[t->attr.ipos++] =
+                ctx->tokens->value[ctx->tokenIndex];
+        match(ctx, NUM);
     }
 }
 
 /* 函数 */
-TreeNode* function_stmt(void) {
-    TreeNode* t = newStmtNode(FuncK);
-    match(FUNCTION);
-    if (t) t->child[0] = type();
-    if (t && token == ID) {
-        t->attr.name = copyString(tokenString);
+TreeNode* function_stmt(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, FuncK);
+    if (ctx->fuseAnalysis) fuseScope(ctx, TRUE);
+    match(ctx, FUNCTION);
+    if (t) t->child[0] = type(ctx);
+    if (t && ctx->token == ID) {
+        t->attr.name = tokenText(ctx);
+        t->column = ctx->column;
     }
-    match(ID);
-    match(LPAREN);
-    if (t) t->child[1] = para_lists();
-    match(RPAREN);
-    if (t) t->child[2] = body();
+    match(ctx, ID);
+    match(ctx, LPAREN);
+    if (t) t->child[1] = para_lists(ctx);
+    match(ctx, RPAREN);
+    if (t) t->child[2] = body(ctx);
+    if (ctx->fuseAnalysis) fuseScope(ctx, FALSE);
     return t;
 }
 
 /* 函数体 */
-TreeNode* body(void) {
-    TreeNode* t = newStmtNode(BodyK);
-    if (token == THEN) {
-        match(THEN);
-        if (token != END) {
-            if (t) t->child[0] = stmt_sequence();
+TreeNode* body(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, BodyK);
+    if (ctx->token == THEN) {
+        match(ctx, THEN);
+        if (ctx->token != END) {
+            if (t) t->child[0] = stmt_sequence(ctx);
         }
-        match(END);
+        match(ctx, END);
     }
     return t;
 }
 
 /* 参数列表 */
-TreeNode* para_lists(void) {
-    TreeNode* t = newStmtNode(ListK);
+TreeNode* para_lists(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, ListK);
     TreeNode* p = NULL;
-    if (token == INT) {
-        p = newExpNode(ParamK);
-        if (p && token == INT) {
-            p->attr.type = copyString(tokenString);
+    if (ctx->token == INT) {
+        p = newExpNode(ctx, ParamK);
+        if (p && ctx->token == INT) {
+            p->attr.type = tokenText(ctx);
         }
-        match(INT);
-        if (p && token == ID) {
-            p->attr.name = copyString(tokenString);
+        match(ctx, INT);
+        if (p && ctx->token == ID) {
+            p->attr.name = tokenText(ctx);
+            p->column = ctx->column;
         }
-        match(ID);
-        p->sibling = para_list();
-    } else if (token == COMMA) {
-        p->sibling = para_list();
+        match(ctx, ID);
+        declared(ctx, p);
+        if (p) p->sibling = para_list(ctx);
+    } else if (ctx->token == COMMA) {
+        /* the first parameter is missing */
+        syntaxError(ctx, "unexpected token -> ");
+        printToken(&ctx->listing, ctx->token, lexeme(ctx));
+        p = para_list(ctx);
     }
     if (t) t->child[0] = p;
     return t;
 }
 
-TreeNode* para_list(void) {
+TreeNode* para_list(Compiler* ctx) {
     TreeNode* p = NULL;
-    if (token == COMMA) {
-        match(token);
-        p = newExpNode(ParamK);
-        if (p && token == INT) {
-            p->attr.type = copyString(tokenString);
+    if (ctx->token == COMMA) {
+        match(ctx, ctx->token);
+        p = newExpNode(ctx, ParamK);
+        if (p && ctx->token == INT) {
+            p->attr.type = tokenText(ctx);
         }
-        match(INT);
-        if (p && token == ID) {
-            p->attr.name = copyString(tokenString);
+        match(ctx, INT);
+        if (p && ctx->token == ID) {
+            p->attr.name = tokenText(ctx);
+            p->column = ctx->column;
         }
-        match(ID);
-        p->sibling = para_list();
+        match(ctx, ID);
+        declared(ctx, p);
+        p->sibling = para_list(ctx);
     }
     return p;
 }
 
 /* 变量类型 */
-TreeNode* type(void) {
-    TreeNode* t = newStmtNode(TypeK);
-    if (token == INT) {
-        if (t) t->attr.type = copyString(tokenString);
-        match(token);
+TreeNode* type(Compiler* ctx) {
+    TreeNode* t = newStmtNode(ctx, TypeK);
+    if (ctx->token == INT) {
+        if (t) t->attr.type = tokenText(ctx);
+        match(ctx, ctx->token);
     }
     return t;
 }
 
-void kind(TreeNode* t) {
-    if (token == NUM || token == ID) {
-        if (t && token == NUM) {
-            t->attr.val = atoi(tokenString);
-        } else if (t && token == ID) {
-            t->attr.type = copyString(tokenString);
+void kind(Compiler* ctx, TreeNode* t) {
+    if (ctx->token == NUM || ctx->token == ID) {
+        if (t && ctx->token == NUM) {
+            t->attr.val = ctx->tokens->value[ctx->tokenIndex];
+        } else if (t && ctx->token == ID) {
+            t->attr.type = tokenText(ctx);
         }
-        match(token);
+        match(ctx, ctx->token);
     }
 }
 
-TreeNode* expp(void) {
-    TreeNode* t = simple_exp();
-    if ((token == LT) || (token == EQ)) {
-        TreeNode* p = newExpNode(OpK);
+/* binary parses operands joined by binary operators
+   of precedence minPrec or higher by precedence
+   climbing over binaryOps */
+static TreeNode* binary(Compiler* ctx, int minPrec) {
+    TreeNode* t = factor(ctx);
+    int prec;
+    while ((prec = binaryOps[ctx->token].prec) >= minPrec) {
+        TokenType op = ctx->token;
+        TreeNode* p = newExpNode(ctx, OpK);
         if (p != NULL) {
             p->child[0] = t;
-            p->attr.op = token;
+            p->attr.op = op;
             t = p;
         }
-        match(token);
-        if (t != NULL) t->child[1] = simple_exp();
+        match(ctx, op);
+        /* the right operand binds only tighter operators,
+           which makes the operator left associative */
+        p = binary(ctx, prec + 1);
+        if (t != NULL) t->child[1] = p;
+        checked(ctx, t);
+        if (binaryOps[op].nonassoc && binaryOps[ctx->token].prec == prec) break;
     }
     return t;
 }
 
-TreeNode* simple_exp(void) {
-    TreeNode* t = term();
-    while ((token == PLUS) || (token == MINUS)) {
-        TreeNode* p = newExpNode(OpK);
-        if (p != NULL) {
-            p->child[0] = t;
-            p->attr.op = token;
-            t = p;
-            match(token);
-            t->child[1] = term();
-        }
-    }
-    return t;
-}
-
-TreeNode* term(void) {
-    TreeNode* t = factor();
-    while ((token == TIMES) || (token == OVER)) {
-        TreeNode* p = newExpNode(OpK);
-        if (p != NULL) {
-            p->child[0] = t;
-            p->attr.op = token;
-            t = p;
-            match(token);
-            p->child[1] = factor();
-        }
-    }
-    return t;
-}
+TreeNode* expp(Compiler* ctx) { return binary(ctx, 1); }
 
-TreeNode* factor(void) {
+TreeNode* factor(Compiler* ctx) {
     TreeNode* t = NULL;
-    switch (token) {
+    switch (ctx->token) {
         case NUM:
         case ID:
-            t = infactor();
+            t = infactor(ctx);
             break;
         case LPAREN:
-            match(LPAREN);
-            t = expp();
-            match(RPAREN);
+            match(ctx, LPAREN);
+            t = expp(ctx);
+            match(ctx, RPAREN);
             break;
         default:
-            syntaxError("unexpected token -> ");
-            printToken(token, tokenString);
-            token = getToken();
+            syntaxError(ctx, "unexpected token -> ");
+            printToken(&ctx->listing, ctx->token, lexeme(ctx));
+            nextToken(ctx);
             break;
     }
     return t;
 }
 
-TreeNode* infactor(void) {
+TreeNode* infactor(Compiler* ctx) {
     TreeNode* t = NULL;
-    if (token == ID) {
-        t = newExpNode(IdK);
-        if (t) t->attr.name = copyString(tokenString);
-        match(token);
-        params(t);
-    } else if (token == NUM) {
-        t = newExpNode(ConstK);
-        if ((t != NULL) && (token == NUM)) t->attr.val = atoi(tokenString);
-        match(token);
+    if (ctx->token == ID) {
+        t = newExpNode(ctx, IdK);
+        if (t) t->attr.name = tokenText(ctx);
+        match(ctx, ctx->token);
+        params(ctx, t);
+        /* a name alone, not an array or a call */
+        if (t && t->kind.exp == IdK) referenced(ctx, t, UseR);
+    } else if (ctx->token == NUM) {
+        t = newExpNode(ctx, ConstK);
+        if ((t != NULL) && (ctx->token == NUM))
+            t->attr.val = ctx->tokens->value[ctx->tokenIndex];
+        match(ctx, ctx->token);
     }
-    return t;
+    return checked(ctx, t);
 }
 
-void params(TreeNode* t) {
-    if (token == LSQU) {
+void params(Compiler* ctx, TreeNode* t) {
+    if (ctx->token == LSQU) {
         t->kind.exp = ArrCK;
-        match(token);
-        if (token == ID || token == NUM) {
-            if (t) t->attr.invo[t->attr.ppos++] = copyString(tokenString);
-            match(token);
-        }
-        match(RSQU);
-        inpara(t);
-    } else if (token == LPAREN) {
-        match(token);
+        inpara(ctx, t);
+    } else if (ctx->token == LPAREN) {
+        match(ctx, ctx->token);
         t->kind.exp = FunCK;
-        t->child[0] = newExpNode(IdK);
+        t->child[0] = newExpNode(ctx, IdK);
         t->child[0]->attr.name = t->attr.name;
-        t->child[1] = inparams();
-        match(RPAREN);
+        t->child[0]->lineno = t->lineno;
+        t->child[0]->column = t->column;
+        referenced(ctx, t->child[0], CallR);
+        checked(ctx, t->child[0]);
+        t->child[1] = inparams(ctx);
+        match(ctx, RPAREN);
     }
 }
 
-TreeNode* inparams(void) {
+TreeNode* inparams(Compiler* ctx) {
     TreeNode *t = NULL, *p = NULL;
-    if (token == ID || token == NUM) {
-        t = newStmtNode(ListK);
-        p = infactor();
-        if (token == COMMA) {
-            p->sibling = inparam();
+    if (ctx->token == ID || ctx->token == NUM) {
+        t = newStmtNode(ctx, ListK);
+        p = infactor(ctx);
+        if (ctx->token == COMMA) {
+            p->sibling = inparam(ctx);
         }
     }
     if (t) t->child[0] = p;
     return t;
 }
 
-TreeNode* inparam(void) {
+TreeNode* inparam(Compiler* ctx) {
     TreeNode* t = NULL;
-    if (token == COMMA) {
-        match(token);
-        t = infactor();
-        if (token == COMMA) {
-            t->sibling = inparam();
+    if (ctx->token == COMMA) {
+        match(ctx, ctx->token);
+        t = infactor(ctx);
+        if (ctx->token == COMMA) {
+            t->sibling = inparam(ctx);
         }
     }
     return t;
 }
 
-void inpara(TreeNode* t) {
-    if (token == LSQU) {
-        match(token);
-        if (token == ID || token == NUM) {
-            if (t) t->attr.invo[t->attr.ppos++] = copyString(tokenString);
-            match(token);
+void inpara(Compiler* ctx, TreeNode* t) {
+    int n = countList(ctx, ctx->tokenIndex, LSQU, ID, NUM, RSQU);
+    char* sub;
+    if (n > 0) t->attr.invo = newArray(ctx, n, sizeof(char*));
+    while (ctx->token == LSQU) {
+        match(ctx, ctx->token);
+        if (ctx->token == ID || ctx->token == NUM) {
+            sub = tokenText(ctx);
+            if (sub && t->attr.invo) t->attr.invo[t->attr.ppos++] = sub;
+            match(ctx, ctx->token);
         }
-        match(RSQU);
-        inpara(t);
+        match(ctx, RSQU);
     }
 }
 
@@ -531,12 +655,30 @@ void inpara(TreeNode* t) {
 /* the primary function of the parser   */
 /****************************************/
 /* Function parse returns the newly
- * constructed syntax tree
+ * constructed syntax tree for the
+ * token stream ts of ctx
  */
-TreeNode* parse(void) {
+TreeNode* parse(Compiler* ctx, TokenStream* ts) {
     TreeNode* t;
-    token = getToken();
-    t = stmt_sequence();
-    if (token != ENDFILE) syntaxError("Code ends before file\n");
+    ctx->tokens = ts;
+    ctx->tokenIndex = -1;
+    ctx->lineStart = -1;
+    nextToken(ctx);
+    t = stmt_sequence(ctx);
+    if (ctx->token != ENDFILE) syntaxError(ctx, "Code ends before file\n");
     return t;
 }
+
+/* Function parseStatement parses the one statement
+ * of the program (a function, a declaration or any
+ * other statement) that starts at token first of ts,
+ * leaving the token after it as the current token
+ * of ctx
+ */
+TreeNode* parseStatement(Compiler* ctx, TokenStream* ts, int first) {
+    ctx->tokens = ts;
+    ctx->tokenIndex = first - 1;
+    ctx->lineStart = -1;
+    nextToken(ctx);
+    return statement(ctx);
+}
@@ -8,10 +8,20 @@
 #ifndef _PARSE_H_
 #define _PARSE_H_
 #include "globals.h"
+#include "scan.h"
 
 /* Function parse returns the newly
- * constructed syntax tree
+ * constructed syntax tree for the
+ * token stream ts of ctx
  */
-TreeNode* parse(void);
+TreeNode* parse(Compiler* ctx, TokenStream* ts);
+
+/* Function parseStatement parses the one statement
+ * of the program (a function, a declaration or any
+ * other statement) that starts at token first of ts,
+ * leaving the token after it as the current token
+ * of ctx
+ */
+TreeNode* parseStatement(Compiler* ctx, TokenStream* ts, int first);
 
 #endif
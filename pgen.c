@@ -0,0 +1,200 @@
+/****************************************************/
+/* File: pgen.c                                     */
+/* Parallel type checking and code generation of   */
+/* the top-level statements of a program            */
+/* Every variable is global, so once buildSymtab    */
+/* has located them the top-level statements are    */
+/* independent: each is a piece taken by a pool of  */
+/* threads, checked into its own listing or coded   */
+/* from location 0, and the pieces are put back     */
+/* together in program order                        */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pgen.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "analyze.h"
+#include "cgen.h"
+#include "code.h"
+#include "compiler.h"
+
+/* trees of fewer than MINNODES nodes per thread
+   are handled serially */
+#ifndef MINNODES
+#define MINNODES (1 << 12)
+#endif
+
+/* Piece is a top-level statement, with what its
+   thread made of it */
+typedef struct {
+    AstRef node;
+    Output out; /* its type errors, or its code from location 0 */
+    int Error;  /* TRUE if it has type errors */
+    int size;   /* the locations its code takes */
+} Piece;
+
+/* Pool is the state of one parallel pass, shared by
+   its threads */
+typedef struct Pool {
+    Compiler* ctx; /* the compilation */
+    Ast* ast;
+    Piece* pieces;
+    int npieces;
+    int nextPiece; /* next piece to be taken by a thread */
+    /* the work run by each thread on each piece, with
+       the compiler state of the thread */
+    void (*work)(struct Pool*, Compiler*, Piece*);
+} Pool;
+
+/* Worker is one thread of a pool; its compiler has
+   its own outputs and emit locations, and shares
+   the symbol table of the compilation, which is
+   only looked up */
+typedef struct {
+    Pool* pool;
+    Compiler ctx;
+} Worker;
+
+/* checkPiece type checks p into its own listing */
+static void checkPiece(Pool* pool, Compiler* w, Piece* p) {
+    w->listing = p->out;
+    w->Error = FALSE;
+    typeCheckNode(w, pool->ast, p->node);
+    p->out = w->listing;
+    p->Error = w->Error;
+}
+
+/* genPiece generates the code of p from location 0 */
+static void genPiece(Pool* pool, Compiler* w, Piece* p) {
+    w->code = p->out;
+    w->emitLoc = w->highEmitLoc = w->tmpOffset = 0;
+    codeGenNode(w, pool->ast, p->node);
+    p->out = w->code;
+    p->size = w->highEmitLoc;
+}
+
+/* runPieces is run by each thread of the pool: it
+   takes the pieces one at a time until none is left */
+static void* runPieces(void* arg) {
+    Worker* w = arg;
+    Pool* pool = w->pool;
+    int i;
+    while ((i = __sync_fetch_and_add(&pool->nextPiece, 1)) < pool->npieces)
+        pool->work(pool, &w->ctx, &pool->pieces[i]);
+    return NULL;
+}
+
+/* runPool applies w to every piece with nthreads
+   threads, the calling thread being one of them; it
+   returns FALSE, having done nothing, when out of
+   memory */
+static int runPool(Pool* pool, void (*w)(Pool*, Compiler*, Piece*),
+                   int nthreads) {
+    pthread_t threads[nthreads];
+    Worker* workers = malloc(nthreads * sizeof(Worker));
+    int started = 0, i;
+    if (workers == NULL) return FALSE;
+    for (i = 0; i < nthreads; i++) {
+        workers[i].pool = pool;
+        initCompiler(&workers[i].ctx, NULL, NULL);
+        workers[i].ctx.TraceCode = pool->ctx->TraceCode;
+        workers[i].ctx.symtab = pool->ctx->symtab;
+    }
+    pool->work = w;
+    pool->nextPiece = 0;
+    while (started < nthreads - 1 && pthread_create(&threads[started], NULL,
+                                                    runPieces,
+                                                    &workers[started + 1]) == 0)
+        started++;
+    runPieces(&workers[0]);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(workers);
+    return TRUE;
+}
+
+/* setUp cuts the syntax tree into its top-level
+   statements for a pool of *nthreads threads, fewer
+   if the tree is small; it returns FALSE when the
+   tree is to be handled serially */
+static int setUp(Pool* pool, Compiler* ctx, Ast* syntaxTree, int* nthreads) {
+    AstRef t;
+    int n = 0;
+    memset(pool, 0, sizeof(*pool));
+    if (*nthreads <= 0) *nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (syntaxTree->count / MINNODES < *nthreads)
+        *nthreads = syntaxTree->count / MINNODES;
+    for (t = syntaxTree->root; t != 0; t = astSibling(syntaxTree, t)) n++;
+    if (n < *nthreads) *nthreads = n;
+    if (*nthreads <= 1 || (pool->pieces = calloc(n, sizeof(Piece))) == NULL)
+        return FALSE;
+    for (t = syntaxTree->root; t != 0; t = astSibling(syntaxTree, t))
+        pool->pieces[pool->npieces++].node = t;
+    pool->ctx = ctx;
+    pool->ast = syntaxTree;
+    return TRUE;
+}
+
+/* Procedure typeCheckParallel type checks the
+ * syntax tree as typeCheck does, once buildSymtab
+ * has given every name its location: each top-level
+ * statement (a function above all) is checked by
+ * one of nthreads threads (0: one per processor)
+ * and the errors are listed in program order, as
+ * typeCheck lists them. Small trees are checked on
+ * one thread
+ */
+void typeCheckParallel(Compiler* ctx, Ast* syntaxTree, int nthreads) {
+    Pool pool;
+    int i;
+    if (!setUp(&pool, ctx, syntaxTree, &nthreads) ||
+        !runPool(&pool, checkPiece, nthreads)) {
+        free(pool.pieces);
+        typeCheck(ctx, syntaxTree);
+        return;
+    }
+    for (i = 0; i < pool.npieces; i++) {
+        Piece* p = &pool.pieces[i];
+        outWrite(&ctx->listing, p->out.text, p->out.length);
+        if (p->out.failed) {
+            outPrintf(&ctx->listing, "Out of memory error in analysis\n");
+            p->Error = TRUE;
+        }
+        if (p->Error) ctx->Error = TRUE;
+        outRelease(&p->out);
+    }
+    free(pool.pieces);
+}
+
+/* Procedure codeGenParallel generates code as
+ * codeGen does: the code of each top-level statement
+ * is generated from location 0 by one of nthreads
+ * threads (0: one per processor), and the pieces are
+ * then laid out in program order and relocated, which
+ * gives the code of codeGen. Small trees are
+ * generated on one thread
+ */
+void codeGenParallel(Compiler* ctx, Ast* syntaxTree, char* codefile,
+                     int nthreads) {
+    Pool pool;
+    int i;
+    if (!setUp(&pool, ctx, syntaxTree, &nthreads) ||
+        !runPool(&pool, genPiece, nthreads)) {
+        free(pool.pieces);
+        codeGen(ctx, syntaxTree, codefile);
+        return;
+    }
+    codeGenStart(ctx, codefile);
+    for (i = 0; i < pool.npieces; i++) {
+        Piece* p = &pool.pieces[i];
+        emitCode(ctx, p->out.text, p->out.length, p->size);
+        /* a piece cut short leaves the code cut short */
+        if (p->out.failed) ctx->code.failed = TRUE;
+        outRelease(&p->out);
+    }
+    codeGenEnd(ctx);
+    free(pool.pieces);
+}
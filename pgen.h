@@ -0,0 +1,34 @@
+/****************************************************/
+/* File: pgen.h                                     */
+/* Parallel type checking and code generation of   */
+/* the top-level statements of a program            */
+/****************************************************/
+
+#ifndef _PGEN_H_
+#define _PGEN_H_
+#include "ast.h"
+#include "globals.h"
+
+/* Procedure typeCheckParallel type checks the
+ * syntax tree as typeCheck does, once buildSymtab
+ * has given every name its location: each top-level
+ * statement (a function above all) is checked by
+ * one of nthreads threads (0: one per processor)
+ * and the errors are listed in program order, as
+ * typeCheck lists them. Small trees are checked on
+ * one thread
+ */
+void typeCheckParallel(Compiler* ctx, Ast* syntaxTree, int nthreads);
+
+/* Procedure codeGenParallel generates code as
+ * codeGen does: the code of each top-level statement
+ * is generated from location 0 by one of nthreads
+ * threads (0: one per processor), and the pieces are
+ * then laid out in program order and relocated, which
+ * gives the code of codeGen. Small trees are
+ * generated on one thread
+ */
+void codeGenParallel(Compiler* ctx, Ast* syntaxTree, char* codefile,
+                     int nthreads);
+
+#endif
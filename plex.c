@@ -0,0 +1,321 @@
+/****************************************************/
+/* File: plex.c                                     */
+/* Parallel lexing of a large source program        */
+/* The source is cut into chunks at newlines, each  */
+/* chunk is scanned speculatively from the START    */
+/* state by a pool of threads, and the chunks are   */
+/* stitched where their token boundaries agree with */
+/* the tokens before them                           */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "plex.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "atom.h"
+#include "compiler.h"
+#include "skip.h"
+
+/* sources shorter than MINCHUNK bytes per thread
+   are scanned serially */
+#ifndef MINCHUNK
+#define MINCHUNK (1 << 16)
+#endif
+
+/* chunks per thread, so that threads that finish
+   early can take over the rest of the work */
+#define CHUNKSPERTHREAD 4
+
+typedef struct {
+    int begin;    /* the chunk is text[begin..end) */
+    int end;
+    int newlines; /* number of newlines in the chunk */
+    int lineBase; /* number of newlines before the chunk */
+    Scanner sc;   /* the scan of the chunk, where it stopped */
+    /* the tokens of the chunk: lines are counted from
+       begin, FLOAT values index tokens.floats and IDs
+       are not interned yet */
+    TokenStream tokens;
+    int* after; /* scan position once each token is scanned */
+    /* malformed literals, by token */
+    int* errorToken;
+    const char** errorMessage;
+    int nerrors;
+    int errorCapacity;
+    int from;   /* first token kept by the stitch */
+    int out;    /* index in the result of token from */
+    int failed; /* out of memory */
+} Chunk;
+
+/* Pool is the state of one parallel scan, shared by
+   its threads */
+typedef struct Pool {
+    Chunk* chunks;
+    int nchunks;
+    int nextChunk; /* next chunk to be taken by a thread */
+    TokenStream* result;
+    /* the work run by each thread on each chunk */
+    void (*work)(struct Pool*, Chunk*);
+} Pool;
+
+/* pushToken records the token just scanned by c->sc */
+static int pushToken(Chunk* c, TokenType tok) {
+    TokenStream* ts = &c->tokens;
+    int i = ts->count;
+    if (i == ts->capacity) {
+        int* after;
+        if (!reserveTokens(ts, i + 1)) return FALSE;
+        after = realloc(c->after, ts->capacity * sizeof(int));
+        if (after == NULL) return FALSE;
+        c->after = after;
+    }
+    ts->kind[i] = (unsigned char)tok;
+    ts->start[i] = c->sc.tokenStart;
+    ts->length[i] = c->sc.tokenLength;
+    ts->line[i] = c->sc.lineno;
+    ts->value[i] = 0;
+    if (tok == NUM)
+        ts->value[i] = c->sc.tokenValue;
+    else if (tok == FLOAT &&
+             (ts->value[i] = addFloat(ts, c->sc.tokenFloat)) < 0)
+        return FALSE;
+    c->after[i] = c->sc.linepos;
+    if (c->sc.error != NULL) {
+        if (c->nerrors == c->errorCapacity) {
+            int cap = c->errorCapacity ? 2 * c->errorCapacity : 16;
+            int* at = realloc(c->errorToken, cap * sizeof(int));
+            const char** msg =
+                at ? realloc(c->errorMessage, cap * sizeof(char*)) : NULL;
+            if (at) c->errorToken = at;
+            if (msg == NULL) return FALSE;
+            c->errorMessage = msg;
+            c->errorCapacity = cap;
+        }
+        c->errorToken[c->nerrors] = i;
+        c->errorMessage[c->nerrors++] = c->sc.error;
+    }
+    ts->count++;
+    return TRUE;
+}
+
+/* lexOne scans one more token of c, returning
+   FALSE when out of memory */
+static int lexOne(Chunk* c) {
+    if (pushToken(c, scanToken(&c->sc))) return TRUE;
+    c->failed = TRUE;
+    return FALSE;
+}
+
+/* lastKind is the kind of the last token of c */
+#define lastKind(c) ((c)->tokens.kind[(c)->tokens.count - 1])
+
+/* lexChunk scans c, as if a token began at its start,
+   up to the first token that reaches past its end */
+static void lexChunk(Pool* pool, Chunk* c) {
+    (void)pool;
+    c->newlines = countByte(c->sc.text, c->begin, c->end, '\n');
+    if (!reserveTokens(&c->tokens, (c->end - c->begin) / 4 + 16) ||
+        (c->after = malloc(c->tokens.capacity * sizeof(int))) == NULL) {
+        c->failed = TRUE;
+        return;
+    }
+    do
+        if (!lexOne(c)) return;
+    while (lastKind(c) != ENDFILE && c->sc.linepos < c->end);
+}
+
+/* copyChunk moves the kept tokens of c to their
+   place in the result, lines counted from the top */
+static void copyChunk(Pool* pool, Chunk* c) {
+    TokenStream* ts = &c->tokens;
+    TokenStream* result = pool->result;
+    int n = ts->count - c->from, i;
+    memcpy(result->kind + c->out, ts->kind + c->from, n);
+    memcpy(result->start + c->out, ts->start + c->from, n * sizeof(int));
+    memcpy(result->length + c->out, ts->length + c->from, n * sizeof(int));
+    memcpy(result->value + c->out, ts->value + c->from, n * sizeof(int));
+    for (i = 0; i < n; i++)
+        result->line[c->out + i] = ts->line[c->from + i] + c->lineBase;
+}
+
+/* runChunks is run by each thread of the pool: it
+   takes the chunks one at a time until none is left */
+static void* runChunks(void* arg) {
+    Pool* pool = arg;
+    int i;
+    while ((i = __sync_fetch_and_add(&pool->nextChunk, 1)) < pool->nchunks)
+        pool->work(pool, &pool->chunks[i]);
+    return NULL;
+}
+
+/* runPool applies w to every chunk with nthreads
+   threads, the calling thread being one of them */
+static void runPool(Pool* pool, void (*w)(Pool*, Chunk*), int nthreads) {
+    pthread_t threads[nthreads];
+    int started = 0, i;
+    pool->work = w;
+    pool->nextChunk = 0;
+    while (started < nthreads - 1 &&
+           pthread_create(&threads[started], NULL, runChunks, pool) == 0)
+        started++;
+    runChunks(pool);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+/* agreed tells whether the scan of c after its token k
+   (k = -1 standing for its start) is in the same state
+   as the scan of p: same position and line, except past
+   ENDFILE where the state differs all the same */
+static int agreed(Chunk* c, int k, Chunk* p) {
+    if (k < 0)
+        return c->begin == p->sc.linepos &&
+               c->lineBase == p->sc.lineno + p->lineBase;
+    return c->after[k] == p->sc.linepos &&
+           c->tokens.kind[k] != ENDFILE &&
+           c->tokens.line[k] + c->lineBase == p->sc.lineno + p->lineBase;
+}
+
+/* align decides which tokens of each chunk the stitch
+   keeps. The scan of the first chunk is right; from
+   the end of a right scan, the scan of the next chunk
+   is right once both agree, since the scanner is then
+   in the same state. Until they do (e.g. for a chunk
+   that begins inside a comment) the right scan goes
+   on by itself, adding tokens to its own chunk */
+static int align(Pool* pool) {
+    Chunk* p = &pool->chunks[0]; /* the chunk of the right scan */
+    Chunk* c;
+    int n, k;
+    for (n = 1; n < pool->nchunks; n++) {
+        c = &pool->chunks[n];
+        c->from = c->tokens.count;
+        if (lastKind(p) == ENDFILE) continue;
+        for (k = -1;;) {
+            while (k < c->tokens.count &&
+                   (k < 0 ? c->begin : c->after[k]) < p->sc.linepos)
+                k++;
+            if (k == c->tokens.count) break;
+            if (agreed(c, k, p)) {
+                c->from = k + 1;
+                p = c;
+                break;
+            }
+            if (!lexOne(p)) return FALSE;
+            if (lastKind(p) == ENDFILE) break;
+        }
+    }
+    while (lastKind(p) != ENDFILE)
+        if (!lexOne(p)) return FALSE;
+    return TRUE;
+}
+
+/* finish interns the identifiers and enters the
+   FLOAT values of ts in order, reporting malformed
+   literals where the serial scanner would */
+static int finish(Compiler* ctx, Pool* pool, TokenStream* ts) {
+    Chunk* c;
+    int n, i, j, e;
+    for (n = 0; n < pool->nchunks; n++) {
+        c = &pool->chunks[n];
+        for (e = 0; e < c->nerrors && c->errorToken[e] < c->from; e++)
+            ;
+        for (j = c->from, i = c->out; j < c->tokens.count; j++, i++) {
+            if (ts->kind[i] == ID) {
+                ts->value[i] = intern(&ctx->atoms,
+                                      ctx->sourceText + ts->start[i],
+                                      ts->length[i]);
+                if (ts->value[i] < 0) return FALSE;
+            } else if (ts->kind[i] == FLOAT &&
+                     (ts->value[i] = addFloat(
+                          ts, c->tokens.floats[c->tokens.value[j]])) < 0)
+                return FALSE;
+            if (e < c->nerrors && c->errorToken[e] == j) {
+                ctx->lineno = ts->line[i];
+                lexError(ctx, c->errorMessage[e++]);
+            }
+        }
+    }
+    ctx->lineno = ts->line[ts->count - 1];
+    return TRUE;
+}
+
+/* Function tokenizeParallel scans the whole source
+ * program into ts like tokenize, splitting it into
+ * chunks at line boundaries that are scanned by
+ * nthreads threads (0: one per processor) and then
+ * stitched together; the tokens are the ones the
+ * serial scanner would produce. It falls back on
+ * tokenize for small sources and when the source
+ * is echoed or the scan traced
+ */
+int tokenizeParallel(Compiler* ctx, TokenStream* ts, int nthreads) {
+    Pool pool = {0};
+    Chunk* chunks;
+    int nchunks, ok = TRUE, total = 0, lines = 0, i, pos;
+    const char* sourceText;
+    int sourceLength;
+    if (nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 1 || ctx->EchoSource || ctx->TraceScan ||
+        (ctx->sourceText == NULL && !loadSource(ctx)) ||
+        ctx->sourceLength / nthreads < MINCHUNK)
+        return tokenize(ctx, ts);
+    sourceText = ctx->sourceText;
+    sourceLength = ctx->sourceLength;
+    nchunks = nthreads * CHUNKSPERTHREAD;
+    if (sourceLength / nchunks < MINCHUNK) nchunks = sourceLength / MINCHUNK;
+    chunks = calloc(nchunks, sizeof(Chunk));
+    if (chunks == NULL) return tokenize(ctx, ts);
+    /* cut after the first newline past each even share
+       of the source; the scanners are set up before the
+       threads start, so the scanner tables are built once */
+    for (i = 0, pos = 0; i < nchunks && pos < sourceLength; i++) {
+        const char* eol = NULL;
+        int cut = (int)((long long)sourceLength * (i + 1) / nchunks);
+        if (cut <= pos) cut = pos + 1;
+        if (cut < sourceLength)
+            eol = memchr(sourceText + cut - 1, '\n', sourceLength - cut + 1);
+        chunks[i].begin = pos;
+        chunks[i].end = eol ? (int)(eol - sourceText) + 1 : sourceLength;
+        scanInit(&chunks[i].sc, sourceText, sourceLength, pos);
+        pos = chunks[i].end;
+    }
+    pool.chunks = chunks;
+    pool.nchunks = nchunks = i;
+    runPool(&pool, lexChunk, nthreads);
+    for (i = 0; i < nchunks; i++) {
+        chunks[i].lineBase = lines;
+        lines += chunks[i].newlines;
+        if (chunks[i].failed) ok = FALSE;
+    }
+    if (ok) ok = align(&pool);
+    ts->count = 0;
+    ts->nfloats = 0;
+    ts->deadFloats = 0;
+    if (ok) {
+        for (i = 0; i < nchunks; i++) {
+            chunks[i].out = total;
+            total += chunks[i].tokens.count - chunks[i].from;
+        }
+        ok = reserveTokens(ts, total);
+    }
+    if (ok) {
+        pool.result = ts;
+        runPool(&pool, copyChunk, nthreads);
+        ts->count = total;
+        ok = finish(ctx, &pool, ts);
+    }
+    if (!ok)
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
+    for (i = 0; i < nchunks; i++) {
+        freeTokens(&chunks[i].tokens);
+        free(chunks[i].after);
+        free(chunks[i].errorToken);
+        free(chunks[i].errorMessage);
+    }
+    free(chunks);
+    return ok;
+}
@@ -0,0 +1,21 @@
+/****************************************************/
+/* File: plex.h                                     */
+/* Parallel lexing of a large source program        */
+/****************************************************/
+
+#ifndef _PLEX_H_
+#define _PLEX_H_
+#include "scan.h"
+
+/* Function tokenizeParallel scans the whole source
+ * program into ts like tokenize, splitting it into
+ * chunks at line boundaries that are scanned by
+ * nthreads threads (0: one per processor) and then
+ * stitched together; the tokens are the ones the
+ * serial scanner would produce. It falls back on
+ * tokenize for small sources and when the source
+ * is echoed or the scan traced
+ */
+int tokenizeParallel(Compiler* ctx, TokenStream* ts, int nthreads);
+
+#endif
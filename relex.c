@@ -0,0 +1,180 @@
+/****************************************************/
+/* File: relex.c                                    */
+/* Incremental re-lexing of an edited source        */
+/* The scan resumes right after the last token that */
+/* the edit cannot change, and the tokens it finds  */
+/* replace the old ones up to the first token after */
+/* the edit where the old and new scans are in the  */
+/* same state                                       */
+/****************************************************/
+
+#include "relex.h"
+
+#include "atom.h"
+#include "compiler.h"
+
+/* settled tells whether the scanner state after a
+   token ending at end is known from the token alone:
+   the token is a slice of text (every token but
+   ENDFILE is), and neither its last character nor
+   the character after it is past the current line */
+static int settled(TokenType tok, int end, const char* text, int length) {
+    return tok != ENDFILE && end < length && text[end - 1] != '\n';
+}
+
+/* pushToken appends the token just scanned by sc to
+   fresh, with its value as entered in ts, and reports
+   a malformed literal */
+static int pushToken(Compiler* ctx, TokenStream* fresh, TokenStream* ts,
+                     Scanner* sc, TokenType tok) {
+    int i = fresh->count;
+    if (i == fresh->capacity && !reserveTokens(fresh, i + 1)) return FALSE;
+    fresh->kind[i] = (unsigned char)tok;
+    fresh->start[i] = sc->tokenStart;
+    fresh->length[i] = sc->tokenLength;
+    fresh->line[i] = sc->lineno;
+    fresh->value[i] = 0;
+    if (tok == NUM)
+        fresh->value[i] = sc->tokenValue;
+    else if (tok == ID &&
+             (fresh->value[i] = intern(&ctx->atoms, sc->text + sc->tokenStart,
+                                       sc->tokenLength)) < 0)
+        return FALSE;
+    else if (tok == FLOAT &&
+             (fresh->value[i] = addFloat(ts, sc->tokenFloat)) < 0)
+        return FALSE;
+    if (sc->error != NULL) {
+        ctx->lineno = sc->lineno;
+        lexError(ctx, sc->error);
+    }
+    fresh->count++;
+    return TRUE;
+}
+
+/* compactFloats renumbers the floats of ts in token
+   order, dropping those of replaced tokens; when out
+   of memory the table is simply left as it is */
+static void compactFloats(TokenStream* ts) {
+    double* f = malloc(ts->floatCapacity * sizeof(double));
+    int i, n = 0;
+    if (f == NULL) return;
+    for (i = 0; i < ts->count; i++)
+        if (ts->kind[i] == FLOAT) {
+            f[n] = ts->floats[ts->value[i]];
+            ts->value[i] = n++;
+        }
+    free(ts->floats);
+    ts->floats = f;
+    ts->nfloats = n;
+    ts->deadFloats = 0;
+}
+
+/* splice replaces tokens first..last-1 of ts by the
+   tokens of fresh, shifting the tokens after them.
+   The floats of the replaced tokens are counted as
+   dead, and compacted away once they outnumber the
+   live ones */
+static int splice(TokenStream* ts, int first, int last, TokenStream* fresh,
+                  int delta, int lineDelta) {
+    int tail = ts->count - last, to = first + fresh->count, i;
+    if (!reserveTokens(ts, to + tail)) return FALSE;
+    for (i = first; i < last; i++)
+        if (ts->kind[i] == FLOAT) ts->deadFloats++;
+    memmove(ts->kind + to, ts->kind + last, tail);
+    memmove(ts->start + to, ts->start + last, tail * sizeof(int));
+    memmove(ts->length + to, ts->length + last, tail * sizeof(int));
+    memmove(ts->line + to, ts->line + last, tail * sizeof(int));
+    memmove(ts->value + to, ts->value + last, tail * sizeof(int));
+    memcpy(ts->kind + first, fresh->kind, fresh->count);
+    memcpy(ts->start + first, fresh->start, fresh->count * sizeof(int));
+    memcpy(ts->length + first, fresh->length, fresh->count * sizeof(int));
+    memcpy(ts->line + first, fresh->line, fresh->count * sizeof(int));
+    memcpy(ts->value + first, fresh->value, fresh->count * sizeof(int));
+    if (delta != 0 || lineDelta != 0)
+        for (i = to; i < to + tail; i++) {
+            ts->start[i] += delta;
+            ts->line[i] += lineDelta;
+        }
+    ts->count = to + tail;
+    if (ts->deadFloats >= 64 && 2 * ts->deadFloats > ts->nfloats)
+        compactFloats(ts);
+    return TRUE;
+}
+
+/* Function relexTokens brings ts, the tokens of a
+ * source program, up to date with an edit that
+ * replaced removed bytes at offset by inserted
+ * bytes, giving text (length bytes). Scanning
+ * starts again at the last token boundary before
+ * the edit and stops once the tokens line up with
+ * the old ones, which are then shifted in place.
+ * ts then refers to text, which should become the
+ * sourceText of ctx before parsing. The tokens
+ * scanned again are told in *edit, if not NULL. It
+ * returns FALSE when out of memory
+ */
+int relexTokens(Compiler* ctx, TokenStream* ts, const char* text, int length,
+                int offset, int removed, int inserted, TokenEdit* edit) {
+    TokenStream fresh = {0};
+    Scanner sc;
+    TokenType tok;
+    int delta = inserted - removed, nfloats = ts->nfloats;
+    int lo = 0, hi = ts->count - 1, mid, r, j, end, ok = TRUE;
+    /* the first token whose scan may read the edit:
+       it reads up to the character after its end */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (ts->start[mid] + ts->length[mid] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    /* resume after the last settled token before it */
+    for (r = lo - 1; r >= 0; r--)
+        if (settled(ts->kind[r], ts->start[r] + ts->length[r], text, length))
+            break;
+    if (r < 0)
+        scanInit(&sc, text, length, 0);
+    else
+        scanResume(&sc, text, length, ts->start[r] + ts->length[r],
+                   ts->line[r]);
+    /* scan until a settled token ends where an old one
+       ends, past the edit: from there on both scans see
+       the same text in the same state */
+    for (j = r + 1;;) {
+        tok = scanToken(&sc);
+        if (!pushToken(ctx, &fresh, ts, &sc, tok)) {
+            ok = FALSE;
+            break;
+        }
+        if (tok == ENDFILE) {
+            j = ts->count;
+            break;
+        }
+        end = sc.linepos;
+        if (end - 1 < offset + inserted || !settled(tok, end, text, length))
+            continue;
+        while (j < ts->count - 1 && ts->start[j] + ts->length[j] + delta < end)
+            j++;
+        if (ts->start[j] + ts->length[j] + delta == end &&
+            ts->kind[j] != ENDFILE) {
+            j++;
+            break;
+        }
+    }
+    if (ok && edit != NULL) {
+        edit->first = r + 1;
+        edit->last = r + 1 + fresh.count;
+        edit->oldLast = j;
+    }
+    if (ok)
+        ok = splice(ts, r + 1, j, &fresh, delta,
+                    j < ts->count ? sc.lineno - ts->line[j - 1] : 0);
+    if (!ok) {
+        /* drop the floats entered for the tokens not spliced in */
+        ts->nfloats = nfloats;
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n", sc.lineno);
+    }
+    freeTokens(&fresh);
+    return ok;
+}
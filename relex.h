@@ -0,0 +1,36 @@
+/****************************************************/
+/* File: relex.h                                    */
+/* Incremental re-lexing of an edited source        */
+/****************************************************/
+
+#ifndef _RELEX_H_
+#define _RELEX_H_
+#include "scan.h"
+
+/* TokenEdit tells which tokens relexTokens scanned
+ * again: the new tokens first..last-1 took the place
+ * of the old tokens first..oldLast-1, and the tokens
+ * after them are the old ones, moved by last-oldLast
+ */
+typedef struct {
+    int first;
+    int last;
+    int oldLast;
+} TokenEdit;
+
+/* Function relexTokens brings ts, the tokens of a
+ * source program, up to date with an edit that
+ * replaced removed bytes at offset by inserted
+ * bytes, giving text (length bytes). Scanning
+ * starts again at the last token boundary before
+ * the edit and stops once the tokens line up with
+ * the old ones, which are then shifted in place.
+ * ts then refers to text, which should become the
+ * sourceText of ctx before parsing. The tokens
+ * scanned again are told in *edit, if not NULL. It
+ * returns FALSE when out of memory
+ */
+int relexTokens(Compiler* ctx, TokenStream* ts, const char* text, int length,
+                int offset, int removed, int inserted, TokenEdit* edit);
+
+#endif
@@ -5,9 +5,21 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#define _POSIX_C_SOURCE 200809L
+
 // #include "globals.h"
 #include "scan.h"
 
+#include <float.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "atom.h"
+#include "compiler.h"
+#include "skip.h"
 #include "util.h"
 
 /* states in scanner DFA */
@@ -32,283 +44,647 @@ typedef enum {
     F5
 } StateType;
 
-/* lexeme of identifier or reserved word */
-char tokenString[MAXTOKENLEN + 1];
-
-/* BUFLEN = length of the input buffer for
-   source code lines */
-#define BUFLEN 256
-
-static char lineBuf[BUFLEN]; /* holds the current line */
-static int linepos = 0;      /* current position in LineBuf */
-static int bufsize = 0;      /* current size of buffer string */
-static int EOF_flag = FALSE; /* corrects ungetNextChar behavior on EOF */
-
-/* getNextChar fetches the next non-blank character
-   from lineBuf, reading in a new line if lineBuf is
-   exhausted */
-static int getNextChar(void) {
-    if (!(linepos < bufsize)) {
-        lineno++;
-        if (fgets(lineBuf, BUFLEN - 1, source)) {
-            if (EchoSource) fprintf(listing, "%4d: %s", lineno, lineBuf);
-            bufsize = strlen(lineBuf);
-            linepos = 0;
-            return lineBuf[linepos++];
-        } else {
-            EOF_flag = TRUE;
+/* NSTATES = the number of scanner DFA states */
+#define NSTATES (F5 + 1)
+
+/* readSource reads a source that cannot be mapped
+   (a pipe or terminal) into one malloc'd buffer */
+static char* readSource(Compiler* ctx, FILE* f, int* len) {
+    int cap = 1 << 16, n = 0;
+    size_t got;
+    char* buf = malloc(cap);
+    while (buf != NULL && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += (int)got;
+        if (n == cap) {
+            char* nbuf = realloc(buf, cap *= 2);
+            if (nbuf == NULL) free(buf);
+            buf = nbuf;
+        }
+    }
+    if (buf == NULL)
+        outPrintf(&ctx->listing, "Out of memory error reading source\n");
+    *len = n;
+    return buf;
+}
+
+/* Function loadSource makes the whole source file
+ * of ctx available as its sourceText: regular files
+ * are mapped, anything else is read in one bulk read
+ */
+int loadSource(Compiler* ctx) {
+    struct stat st;
+    int fd = fileno(ctx->source);
+    closeSource(ctx);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ctx->sourceText = p;
+            ctx->sourceLength = (int)st.st_size;
+            ctx->sourceMapped = TRUE;
+        }
+    }
+    if (ctx->sourceText == NULL) {
+        ctx->sourceText = readSource(ctx, ctx->source, &ctx->sourceLength);
+        if (ctx->sourceText == NULL) return FALSE;
+    }
+    ctx->scannerReady = FALSE;
+    return TRUE;
+}
+
+/* Procedure useSource makes the length bytes at
+ * text the sourceText of ctx in place of its source
+ * file; the text stays the caller's and must outlive
+ * the compilation
+ */
+void useSource(Compiler* ctx, const char* text, int length) {
+    closeSource(ctx);
+    ctx->sourceText = text;
+    ctx->sourceLength = length;
+    ctx->sourceBorrowed = TRUE;
+    ctx->scannerReady = FALSE;
+}
+
+/* Procedure closeSource releases the source text */
+void closeSource(Compiler* ctx) {
+    if (ctx->sourceText != NULL && !ctx->sourceBorrowed) {
+        if (ctx->sourceMapped)
+            munmap((void*)ctx->sourceText, ctx->sourceLength);
+        else
+            free((void*)ctx->sourceText);
+    }
+    ctx->sourceText = NULL;
+    ctx->sourceLength = 0;
+    ctx->sourceMapped = FALSE;
+    ctx->sourceBorrowed = FALSE;
+}
+
+/* getNextChar fetches the next character from
+   the text of sc, moving on to a new line (and
+   echoing it) when the current line is exhausted */
+static int getNextChar(Scanner* sc) {
+    if (!(sc->linepos < sc->bufsize)) {
+        const char* eol;
+        sc->lineno++;
+        if (sc->linepos >= sc->length) {
+            sc->EOF_flag = TRUE;
             return EOF;
         }
-    } else
-        return lineBuf[linepos++];
+        eol = memchr(sc->text + sc->linepos, '\n', sc->length - sc->linepos);
+        sc->bufsize = eol ? (int)(eol - sc->text) + 1 : sc->length;
+        if (sc->echo) {
+            outPrintf(sc->echo, "%4d: ", sc->lineno);
+            outWrite(sc->echo, sc->text + sc->linepos,
+                     sc->bufsize - sc->linepos);
+        }
+    }
+    return (unsigned char)sc->text[sc->linepos++];
+}
+
+/* advanceTo moves the scan position of sc forward
+   to pos, leaving lineno, the current line and the
+   source echo as if every character before pos had
+   been fetched by getNextChar */
+static void advanceTo(Scanner* sc, int pos) {
+    const char* eol;
+    if (pos > sc->bufsize) {
+        if (sc->echo) {
+            while (sc->bufsize < pos) {
+                sc->lineno++;
+                eol = memchr(sc->text + sc->bufsize, '\n',
+                             sc->length - sc->bufsize);
+                sc->linepos = sc->bufsize;
+                sc->bufsize = eol ? (int)(eol - sc->text) + 1 : sc->length;
+                outPrintf(sc->echo, "%4d: ", sc->lineno);
+                outWrite(sc->echo, sc->text + sc->linepos,
+                         sc->bufsize - sc->linepos);
+            }
+        } else {
+            sc->lineno += 1 + countByte(sc->text, sc->bufsize, pos - 1, '\n');
+            eol = memchr(sc->text + pos - 1, '\n', sc->length - pos + 1);
+            sc->bufsize = eol ? (int)(eol - sc->text) + 1 : sc->length;
+        }
+    }
+    sc->linepos = pos;
 }
 
 /* ungetNextChar backtracks one character
-   in lineBuf */
-static void ungetNextChar(void) {
-    if (!EOF_flag) linepos--;
+   in the text of sc */
+static void ungetNextChar(Scanner* sc) {
+    if (!sc->EOF_flag) sc->linepos--;
 }
 
-/* lookup table of reserved words */
+/* KWHASH is a perfect hash for the reserved words:
+   on length plus first, second and last character it
+   sends each of the MAXRESERVED words to its own slot
+   of a KWSLOTS-entry table (multipliers found by an
+   exhaustive search over the word list) */
+#define KWSLOTS 16
+#define KWHASH(u, len) \
+    (((len) + 2 * (u)[0] + 2 * (u)[1] + 5 * (u)[(len)-1]) & (KWSLOTS - 1))
+
+/* shortest and longest reserved word */
+#define MINRESERVEDLEN 2
+#define MAXRESERVEDLEN 8
+
+/* lookup table of reserved words, indexed by KWHASH */
 static struct {
     char* str;
+    int len;
     TokenType tok;
-} reservedWords[MAXRESERVED] = {{"if", IF},         {"then", THEN},
-                                {"else", ELSE},     {"end", END},
-                                {"repeat", REPEAT}, {"until", UNTIL},
-                                {"read", READ},     {"write", WRITE},
-                                {"int", INT},       {"function", FUNCTION},
-                                {"while", WHILE},   {"do", DO},
-                                {"return", RETURN}};
+} reservedWords[KWSLOTS] = {
+    {"write", 5, WRITE},     {NULL, 0, ID},           {"then", 4, THEN},
+    {"do", 2, DO},           {"function", 8, FUNCTION}, {"int", 3, INT},
+    {"read", 4, READ},       {"until", 5, UNTIL},     {"repeat", 6, REPEAT},
+    {NULL, 0, ID},           {"return", 6, RETURN},   {NULL, 0, ID},
+    {"while", 5, WHILE},     {"end", 3, END},         {"if", 2, IF},
+    {"else", 4, ELSE}};
 
 /* lookup an identifier to see if it is a reserved word */
-/* uses linear search */
-static TokenType reservedLookup(char* s) {
-    int i;
-    for (i = 0; i < MAXRESERVED; i++)
-        if (!strcmp(s, reservedWords[i].str)) return reservedWords[i].tok;
+/* uses the perfect hash: at most one memcmp */
+static TokenType reservedLookup(const char* s, int len) {
+    const unsigned char* u = (const unsigned char*)s;
+    int h;
+    if (len < MINRESERVEDLEN || len > MAXRESERVEDLEN) return ID;
+    h = KWHASH(u, len);
+    if (reservedWords[h].len == len && !memcmp(s, reservedWords[h].str, len))
+        return reservedWords[h].tok;
     return ID;
 }
 
-/****************************************/
-/* the primary function of the scanner  */
-/****************************************/
-/* function getToken returns the
- * next token in source file
+/* character classes: every input character (and EOF)
+   falls in exactly one class, and the DFA transitions
+   are defined per class instead of per character */
+typedef enum {
+    CC_BLANK,  /* ' ' '\t' '\n' */
+    CC_DIGIT,  /* 0-9 */
+    CC_LETTER, /* a-z A-Z except E */
+    CC_E,      /* E: a letter, and the exponent mark */
+    CC_DOT,    /* . */
+    CC_SIGN,   /* + - */
+    CC_STAR,   /* * */
+    CC_SLASH,  /* / */
+    CC_COLON,  /* : */
+    CC_EQ,     /* = */
+    CC_LBRACE, /* { */
+    CC_RBRACE, /* } */
+    CC_SINGLE, /* < ( ) ; , [ ] */
+    CC_OTHER,  /* anything else */
+    CC_EOF,
+    NCLASSES
+} CharClass;
+
+/* flags of a DFA transition */
+#define T_SAVE 1  /* the character belongs to the lexeme */
+#define T_UNGET 2 /* the character is pushed back */
+#define T_BYCHAR 4 /* the token depends on the character */
+
+/* a DFA transition: next state, flags and, when the
+   next state is DONE, the token recognized */
+typedef struct {
+    unsigned char next;
+    unsigned char flags;
+    unsigned char tok;
+} Transition;
+
+static unsigned char charClass[256];
+static Transition transition[NSTATES][NCLASSES];
+/* runMask[s] has bit k set when a character of class k
+   leaves state s unchanged, so a run of such characters
+   can be consumed by a tight loop */
+static unsigned runMask[NSTATES];
+/* the token of each single-character symbol */
+static unsigned char singleToken[256];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+#define ALLCLASSES (-1)
+
+/* setEdge sets the transitions of state s on class
+   cls (or on every class) */
+static void setEdge(StateType s, int cls, StateType next, int flags,
+                    TokenType tok) {
+    int k;
+    for (k = 0; k < NCLASSES; k++)
+        if (cls == ALLCLASSES || cls == k) {
+            transition[s][k].next = next;
+            transition[s][k].flags = flags;
+            transition[s][k].tok = tok;
+        }
+}
+
+/* initScanTables builds the character class table and
+   the transition table from the DFA states */
+static void initScanTables(void) {
+    int c, s, k;
+    for (c = 0; c < 256; c++) {
+        if (c >= '0' && c <= '9')
+            charClass[c] = CC_DIGIT;
+        else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            charClass[c] = CC_LETTER;
+        else
+            charClass[c] = CC_OTHER;
+    }
+    charClass['E'] = CC_E;
+    charClass[' '] = charClass['\t'] = charClass['\n'] = CC_BLANK;
+    charClass['.'] = CC_DOT;
+    charClass['+'] = charClass['-'] = CC_SIGN;
+    charClass['*'] = CC_STAR;
+    charClass['/'] = CC_SLASH;
+    charClass[':'] = CC_COLON;
+    charClass['='] = CC_EQ;
+    charClass['{'] = CC_LBRACE;
+    charClass['}'] = CC_RBRACE;
+    charClass['<'] = charClass['('] = charClass[')'] = CC_SINGLE;
+    charClass[';'] = charClass[','] = CC_SINGLE;
+    charClass['['] = charClass[']'] = CC_SINGLE;
+
+    singleToken['='] = EQ;
+    singleToken['<'] = LT;
+    singleToken['+'] = PLUS;
+    singleToken['-'] = MINUS;
+    singleToken['*'] = TIMES;
+    singleToken['('] = LPAREN;
+    singleToken[')'] = RPAREN;
+    singleToken[';'] = SEMI;
+    singleToken[','] = COMMA;
+    singleToken['['] = LSQU;
+    singleToken[']'] = RSQU;
+
+    setEdge(START, ALLCLASSES, DONE, T_SAVE, ERROR);
+    setEdge(START, CC_BLANK, START, 0, ERROR);
+    setEdge(START, CC_DIGIT, INNUM, T_SAVE, ERROR);
+    setEdge(START, CC_LETTER, INID, T_SAVE, ERROR);
+    setEdge(START, CC_E, INID, T_SAVE, ERROR);
+    setEdge(START, CC_COLON, INASSIGN, T_SAVE, ERROR);
+    setEdge(START, CC_LBRACE, INCOMMENT, 0, ERROR);
+    // 多行注释/**/开始, 同时也是除号
+    setEdge(START, CC_SLASH, S1, 0, ERROR);
+    setEdge(START, CC_SIGN, DONE, T_SAVE | T_BYCHAR, ERROR);
+    setEdge(START, CC_STAR, DONE, T_SAVE | T_BYCHAR, ERROR);
+    setEdge(START, CC_EQ, DONE, T_SAVE | T_BYCHAR, ERROR);
+    setEdge(START, CC_SINGLE, DONE, T_SAVE | T_BYCHAR, ERROR);
+    setEdge(START, CC_EOF, DONE, 0, ENDFILE);
+
+    // 除号被接受
+    setEdge(S1, ALLCLASSES, DONE, T_UNGET, OVER);
+    setEdge(S1, CC_STAR, S2, 0, ERROR);
+    setEdge(S2, ALLCLASSES, S2, 0, ERROR);
+    setEdge(S2, CC_STAR, S3, 0, ERROR);
+    setEdge(S2, CC_EOF, DONE, 0, ENDFILE);
+    setEdge(S3, ALLCLASSES, S2, 0, ERROR);
+    setEdge(S3, CC_STAR, S3, 0, ERROR);
+    setEdge(S3, CC_SLASH, START, 0, ERROR);
+    setEdge(S3, CC_EOF, DONE, 0, ENDFILE);
+
+    setEdge(INCOMMENT, ALLCLASSES, INCOMMENT, 0, ERROR);
+    setEdge(INCOMMENT, CC_RBRACE, START, 0, ERROR);
+    setEdge(INCOMMENT, CC_EOF, DONE, 0, ENDFILE);
+
+    setEdge(INASSIGN, ALLCLASSES, DONE, T_UNGET, ERROR);
+    setEdge(INASSIGN, CC_EQ, DONE, T_SAVE, ASSIGN);
+
+    setEdge(INNUM, ALLCLASSES, DONE, T_UNGET, NUM);
+    setEdge(INNUM, CC_DIGIT, INNUM, T_SAVE, ERROR);
+    setEdge(INNUM, CC_E, F3, T_SAVE, ERROR);
+    setEdge(INNUM, CC_DOT, F1, T_SAVE, ERROR);
+
+    /* 浮点数: the F states accept what the original
+       switch accepted; an incomplete number at EOF is
+       an error instead of an endless loop */
+    setEdge(F1, ALLCLASSES, F1, T_SAVE, ERROR);
+    setEdge(F1, CC_DIGIT, F2, T_SAVE, ERROR);
+    setEdge(F1, CC_EOF, DONE, 0, ERROR);
+    setEdge(F2, ALLCLASSES, DONE, T_UNGET, FLOAT);
+    setEdge(F2, CC_DIGIT, F2, T_SAVE, ERROR);
+    setEdge(F2, CC_E, F3, T_SAVE, ERROR);
+    setEdge(F3, ALLCLASSES, F3, T_SAVE, ERROR);
+    setEdge(F3, CC_DIGIT, F5, T_SAVE, ERROR);
+    setEdge(F3, CC_SIGN, F4, T_SAVE, ERROR);
+    setEdge(F3, CC_EOF, DONE, 0, ERROR);
+    setEdge(F4, ALLCLASSES, F4, T_SAVE, ERROR);
+    setEdge(F4, CC_DIGIT, F5, T_SAVE, ERROR);
+    setEdge(F4, CC_EOF, DONE, 0, ERROR);
+    setEdge(F5, ALLCLASSES, DONE, T_UNGET, FLOAT);
+    setEdge(F5, CC_DIGIT, F5, T_SAVE, ERROR);
+
+    setEdge(INID, ALLCLASSES, DONE, T_UNGET, ID);
+    setEdge(INID, CC_LETTER, INID, T_SAVE, ERROR);
+    setEdge(INID, CC_E, INID, T_SAVE, ERROR);
+
+    setEdge(DONE, ALLCLASSES, DONE, 0, ERROR);
+
+    initSkip();
+
+    for (s = 0; s < NSTATES; s++) {
+        runMask[s] = 0;
+        for (k = 0; k < CC_EOF; k++)
+            if (s != DONE && transition[s][k].next == s &&
+                !(transition[s][k].flags & T_UNGET))
+                runMask[s] |= 1u << k;
+    }
+}
+
+/* the value of a numeric literal is accumulated
+   while its digits are scanned: the integer value
+   in INNUM, and for floats the significant digits
+   and the decimal exponent in INNUM, F2 and F5 */
+#define MAXSIGDIGITS 19
+#define MAXEXPONENT 100000
+
+/* Procedure lexError reports a malformed literal
+ * at line lineno of ctx
  */
-TokenType getToken(void) {
-    /* index for storing into tokenString */
-    int tokenStringIndex = 0;
+void lexError(Compiler* ctx, const char* message) {
+    outPrintf(&ctx->listing, "\n>>> Lexical error at line %d: %s\n",
+              ctx->lineno, message);
+    ctx->Error = TRUE;
+}
+
+/* addMantissa adds one digit to the significant
+   digits; digits past MAXSIGDIGITS only scale */
+static void addMantissa(Scanner* sc, int d) {
+    if (sc->sigDigits < MAXSIGDIGITS) {
+        sc->mantissa = sc->mantissa * 10 + d;
+        if (sc->mantissa != 0) sc->sigDigits++;
+    } else
+        sc->decExponent++;
+}
+
+/* scanDigits adds the digit c and the run of digits
+   that follows it on the line to the literal value */
+static void scanDigits(Scanner* sc, StateType state, int c) {
+    const unsigned char* text = (const unsigned char*)sc->text;
+    int d;
+    for (;;) {
+        d = c - '0';
+        if (state == INNUM) {
+            if (sc->intValue > (INT_MAX - d) / 10)
+                sc->intOverflow = TRUE;
+            else
+                sc->intValue = sc->intValue * 10 + d;
+            addMantissa(sc, d);
+        } else if (state == F2) {
+            addMantissa(sc, d);
+            sc->decExponent--;
+        } else if (sc->expValue < MAXEXPONENT)
+            sc->expValue = sc->expValue * 10 + d;
+        if (sc->linepos >= sc->bufsize ||
+            charClass[text[sc->linepos]] != CC_DIGIT)
+            break;
+        c = text[sc->linepos++];
+    }
+}
+
+/* floatValue scales the accumulated mantissa by its
+   decimal exponent, one binary power of ten at a time
+   so that tiny values do not overflow the divisor */
+static double floatValue(const Scanner* sc) {
+    static const double pow10[] = {1e1,  1e2,  1e4,   1e8,  1e16,
+                                   1e32, 1e64, 1e128, 1e256};
+    double v = sc->mantissa;
+    int e = sc->decExponent + (sc->expNegative ? -sc->expValue : sc->expValue);
+    int neg = e < 0, i;
+    if (neg) e = -e;
+    if (e > 511) e = 511; /* beyond the range of double */
+    for (i = 0; e != 0; i++, e >>= 1)
+        if (e & 1) v = neg ? v / pow10[i] : v * pow10[i];
+    return v;
+}
+
+/* Procedure scanInit prepares sc to scan text from
+ * pos, which must be the start of a line; lines are
+ * counted from there, so the first one is line 1
+ */
+void scanInit(Scanner* sc, const char* text, int length, int pos) {
+    pthread_once(&tablesOnce, initScanTables);
+    memset(sc, 0, sizeof(*sc));
+    sc->text = text;
+    sc->length = length;
+    sc->linepos = sc->bufsize = pos;
+}
+
+/* Procedure scanResume prepares sc to go on scanning
+ * text from pos, right after a token of line lineno
+ * whose last character is not the end of its line
+ */
+void scanResume(Scanner* sc, const char* text, int length, int pos,
+                int lineno) {
+    const char* eol = memchr(text + pos, '\n', length - pos);
+    scanInit(sc, text, length, pos);
+    sc->bufsize = eol ? (int)(eol - text) + 1 : length;
+    sc->lineno = lineno;
+}
+
+/* function scanToken returns the next token in the
+ * text of sc; it does no tracing, and a malformed
+ * literal is left in sc->error instead of reported
+ */
+TokenType scanToken(Scanner* sc) {
     /* holds current token to be returned */
-    TokenType currentToken;
+    TokenType currentToken = ERROR;
     /* current state - always begins at START */
     StateType state = START;
-    /* flag to indicate save to tokenString */
-    int save;
+    StateType from;
+    const unsigned char* text = (const unsigned char*)sc->text;
+    const Transition* t;
+    int c;
+    sc->tokenStart = sc->linepos;
+    sc->tokenLength = 0;
+    sc->error = NULL;
+    sc->intValue = sc->intOverflow = 0;
+    sc->mantissa = 0.0;
+    sc->sigDigits = sc->decExponent = sc->expValue = sc->expNegative = 0;
     while (state != DONE) {
-        int c = getNextChar();
-        save = TRUE;
-        switch (state) {
-            case START:
-                if (isdigit(c)) {
-                    state = INNUM;
-                } else if (isalpha(c)) {
-                    state = INID;
-                } else if (c == ':') {
-                    state = INASSIGN;
-                } else if ((c == ' ') || (c == '\t') || (c == '\n')) {
-                    save = FALSE;
-                } else if (c == '{') {
-                    save = FALSE;
-                    state = INCOMMENT;
-                } else if (c == '/') {
-                    // 多行注释/**/开始
-                    // 同时也是除号
-                    save = FALSE;
-                    state = S1;
-                } else {
-                    state = DONE;
-                    switch (c) {
-                        case EOF:
-                            save = FALSE;
-                            currentToken = ENDFILE;
-                            break;
-                        case '=':
-                            currentToken = EQ;
-                            break;
-                        case '<':
-                            currentToken = LT;
-                            break;
-                        case '+':
-                            currentToken = PLUS;
-                            break;
-                        case '-':
-                            currentToken = MINUS;
-                            break;
-                        case '*':
-                            currentToken = TIMES;
-                            break;
-                        // case '/':
-                        //     currentToken = OVER;
-                        //     break;
-                        case '(':
-                            currentToken = LPAREN;
-                            break;
-                        case ')':
-                            currentToken = RPAREN;
-                            break;
-                        case ';':
-                            currentToken = SEMI;
-                            break;
-                        /*把逗号作为符号添加进词法分析*/
-                        case ',':
-                            currentToken = COMMA;
-                            break;
-                            /*把左中括号作为符号添加进词法分析*/
-                        case '[':
-                            currentToken = LSQU;
-                            break;
-                            /*把右中括号作为符号添加进词法分析*/
-                        case ']':
-                            currentToken = RSQU;
-                            break;
-                        default:
-                            currentToken = ERROR;
-                            break;
-                    }
-                }
-                break;
-            case S1:
-                save = FALSE;
-                if (c == '*') {
-                    state = S2;
-                } else {
-                    // 除号被接受
-                    ungetNextChar();
-                    currentToken = OVER;
-                    state = DONE;
-                }
-                break;
-            case S2:
-                save = FALSE;
-                if (c == '*') {
-                    state = S3;
-                } else {
-                    state = S2;
-                }
-                break;
-            case S3:
-                save = FALSE;
-                if (c == '*') {
-                    state = S3;
-                } else if (c == '/') {
-                    state = START;
-                } else if (c == EOF) {
-                    state = DONE;
-                    currentToken = ENDFILE;
-                } else {
-                    state = S2;
-                }
-                break;
-            case INCOMMENT:
-                save = FALSE;
-                if (c == EOF) {
-                    state = DONE;
-                    currentToken = ENDFILE;
-                } else if (c == '}')
-                    state = START;
-                break;
-            case INASSIGN:
-                state = DONE;
-                if (c == '=')
-                    currentToken = ASSIGN;
-                else { /* backup in the input */
-                    ungetNextChar();
-                    save = FALSE;
-                    currentToken = ERROR;
-                }
-                break;
-            case INNUM:
-                if (!isdigit(c)) {
-                    if (c == 'E') {
-                        state = F3;
-                    } else if (c == '.') {
-                        state = F1;
-                    } else { /* backup in the input */
-                        ungetNextChar();
-                        save = FALSE;
-                        state = DONE;
-                        currentToken = NUM;
-                    }
-                }
-                break;
-            case F1:
-                if (isdigit(c)) {
-                    state = F2;
-                }
-                break;
-            case F2:
-                if (!isdigit(c)) {
-                    if (c == 'E') {
-                        state = F3;
-                    } else {
-                        ungetNextChar();
-                        save = FALSE;
-                        state = DONE;
-                        currentToken = FLOAT;
-                    }
-                }
-                break;
-            case F3:
-                if (isdigit(c)) {
-                    state = F5;
-                } else {
-                    if (c == '+' || c == '-') {
-                        state = F4;
-                    }
-                }
-                break;
-            case F4:
-                if (isdigit(c)) {
-                    state = F5;
-                }
-                break;
-            case F5:
-                if (!isdigit(c)) {
-                    ungetNextChar();
-                    save = FALSE;
-                    state = DONE;
-                    currentToken = FLOAT;
-                }
-                break;
-            case INID:
-                if (!isalpha(c)) { /* backup in the input */
-                    ungetNextChar();
-                    save = FALSE;
-                    state = DONE;
-                    currentToken = ID;
-                }
-                break;
-            case DONE:
-            default: /* should never happen */
-                fprintf(listing, "Scanner Bug: state= %d\n", state);
-                state = DONE;
-                currentToken = ERROR;
-                break;
-        }
-        if ((save) && (tokenStringIndex <= MAXTOKENLEN)) {
-            tokenString[tokenStringIndex++] = (char)c;
+        c = getNextChar(sc);
+        from = state;
+        t = &transition[state][c == EOF ? CC_EOF : charClass[c]];
+        if (t->flags & T_SAVE) {
+            if (sc->tokenLength == 0) sc->tokenStart = sc->linepos - 1;
+            sc->tokenLength = sc->linepos - sc->tokenStart;
         }
+        if (t->flags & T_UNGET) ungetNextChar(sc);
+        state = t->next;
         if (state == DONE) {
-            tokenString[tokenStringIndex] = '\0';
-            if (currentToken == ID) {
-                currentToken = reservedLookup(tokenString);
-            }
+            currentToken = (t->flags & T_BYCHAR) ? singleToken[c] : t->tok;
+        } else if (state == START) {
+            /* blanks, comment text and comment bodies may span
+               many lines: they are crossed with the vector
+               kernels, counting the newlines skipped */
+            advanceTo(sc, skipBlanks(sc->text, sc->linepos, sc->length));
+        } else if (state == INCOMMENT) {
+            advanceTo(sc, findByte(sc->text, sc->linepos, sc->length, '}'));
+        } else if (state == S2) {
+            advanceTo(sc, findByte(sc->text, sc->linepos, sc->length, '*'));
+        } else if (state == INNUM || state == F2 || state == F5) {
+            /* the digits of a number are converted as they
+               are consumed */
+            scanDigits(sc, state, c);
+            sc->tokenLength = sc->linepos - sc->tokenStart;
+        } else if (runMask[state]) {
+            if (state == F4 && from == F3) sc->expNegative = c == '-';
+            /* consume the rest of the current line that keeps
+               the state, e.g. identifier letters, digits,
+               blanks or comment text, in one tight loop */
+            while (sc->linepos < sc->bufsize &&
+                   (runMask[state] >> charClass[text[sc->linepos]]) & 1)
+                sc->linepos++;
+            if (t->flags & T_SAVE)
+                sc->tokenLength = sc->linepos - sc->tokenStart;
         }
     }
-    if (TraceScan) {
-        fprintf(listing, "\t%d: ", lineno);
-        printToken(currentToken, tokenString);
+    if (currentToken == OVER) {
+        /* the '/' is not saved, as it may open a comment */
+        sc->tokenStart = sc->linepos - 1;
+        sc->tokenLength = 1;
+    } else if (currentToken == ID)
+        currentToken =
+            reservedLookup(sc->text + sc->tokenStart, sc->tokenLength);
+    else if (currentToken == NUM) {
+        sc->tokenValue = sc->intValue;
+        if (sc->intOverflow) {
+            sc->tokenValue = INT_MAX;
+            sc->error = "integer constant too large";
+        }
+    } else if (currentToken == FLOAT) {
+        sc->tokenFloat = floatValue(sc);
+        if (sc->tokenFloat > DBL_MAX)
+            sc->error = "floating constant out of range";
+    }
+    return currentToken;
+} /* end scanToken */
+
+/****************************************/
+/* the primary function of the scanner  */
+/****************************************/
+/* function getToken returns the
+ * next token in source file
+ */
+TokenType getToken(Compiler* ctx) {
+    Scanner* sc = &ctx->scanner;
+    TokenType currentToken;
+    int n;
+    if (!ctx->scannerReady) {
+        if (ctx->sourceText == NULL && !loadSource(ctx)) {
+            ctx->lineno++;
+            ctx->tokenStart = ctx->tokenLength = 0;
+            ctx->tokenString[0] = '\0';
+            return ENDFILE;
+        }
+        scanInit(sc, ctx->sourceText, ctx->sourceLength, 0);
+        if (ctx->EchoSource) sc->echo = &ctx->listing;
+        ctx->scannerReady = TRUE;
+    }
+    currentToken = scanToken(sc);
+    ctx->lineno = sc->lineno;
+    ctx->tokenStart = sc->tokenStart;
+    ctx->tokenLength = sc->tokenLength;
+    ctx->tokenValue = sc->tokenValue;
+    ctx->tokenFloat = sc->tokenFloat;
+    n = ctx->tokenLength < MAXTOKENLEN ? ctx->tokenLength : MAXTOKENLEN;
+    memcpy(ctx->tokenString, ctx->sourceText + ctx->tokenStart, n);
+    ctx->tokenString[n] = '\0';
+    if (sc->error != NULL) lexError(ctx, sc->error);
+    if (ctx->TraceScan) {
+        outPrintf(&ctx->listing, "\t%d: ", ctx->lineno);
+        printToken(&ctx->listing, currentToken, ctx->tokenString);
     }
     return currentToken;
 } /* end getToken */
+
+/* Function reserveTokens makes room in ts for n
+ * tokens, doubling its capacity as needed; it
+ * returns FALSE when out of memory
+ */
+int reserveTokens(TokenStream* ts, int n) {
+    int cap = ts->capacity ? ts->capacity : 1024;
+    while (cap < n) cap *= 2;
+    if (cap == ts->capacity) return TRUE;
+    unsigned char* kind = realloc(ts->kind, cap);
+    int* start = kind ? realloc(ts->start, cap * sizeof(int)) : NULL;
+    int* length = start ? realloc(ts->length, cap * sizeof(int)) : NULL;
+    int* line = length ? realloc(ts->line, cap * sizeof(int)) : NULL;
+    int* value = line ? realloc(ts->value, cap * sizeof(int)) : NULL;
+    if (kind) ts->kind = kind;
+    if (start) ts->start = start;
+    if (length) ts->length = length;
+    if (line) ts->line = line;
+    if (value == NULL) return FALSE;
+    ts->value = value;
+    ts->capacity = cap;
+    return TRUE;
+}
+
+/* Function addFloat enters a FLOAT value in the
+ * side table of ts and returns its index, or -1
+ * when out of memory
+ */
+int addFloat(TokenStream* ts, double v) {
+    if (ts->nfloats == ts->floatCapacity) {
+        int cap = ts->floatCapacity ? 2 * ts->floatCapacity : 64;
+        double* f = realloc(ts->floats, cap * sizeof(double));
+        if (f == NULL) return -1;
+        ts->floats = f;
+        ts->floatCapacity = cap;
+    }
+    ts->floats[ts->nfloats] = v;
+    return ts->nfloats++;
+}
+
+/* Function appendToken adds a token of the source
+ * text of ctx to ts: ID tokens are interned and FLOAT
+ * values entered in the side table; it returns FALSE
+ * when out of memory
+ */
+int appendToken(Compiler* ctx, TokenStream* ts, TokenType tok, int start,
+                int length, int line, int value, double fvalue) {
+    int i;
+    if (ts->count == ts->capacity && !reserveTokens(ts, ts->count + 1))
+        return FALSE;
+    i = ts->count;
+    ts->kind[i] = (unsigned char)tok;
+    ts->start[i] = start;
+    ts->length[i] = length;
+    ts->line[i] = line;
+    if (tok == NUM)
+        ts->value[i] = value;
+    else if (tok == FLOAT) {
+        if ((ts->value[i] = addFloat(ts, fvalue)) < 0) return FALSE;
+    } else if (tok == ID) {
+        ts->value[i] = intern(&ctx->atoms, ctx->sourceText + start, length);
+        if (ts->value[i] < 0) return FALSE;
+    } else
+        ts->value[i] = 0;
+    ts->count++;
+    return TRUE;
+}
+
+/* Function tokenize scans the whole source program
+ * into ts in one pass; it returns FALSE when out of
+ * memory
+ */
+int tokenize(Compiler* ctx, TokenStream* ts) {
+    TokenType tok;
+    ts->count = 0;
+    ts->nfloats = 0;
+    ts->deadFloats = 0;
+    do {
+        tok = getToken(ctx);
+        if (!appendToken(ctx, ts, tok, ctx->tokenStart, ctx->tokenLength,
+                         ctx->lineno, ctx->tokenValue, ctx->tokenFloat)) {
+            outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                      ctx->lineno);
+            return FALSE;
+        }
+    } while (tok != ENDFILE);
+    return TRUE;
+}
+
+/* Procedure freeTokens releases the arrays of ts */
+void freeTokens(TokenStream* ts) {
+    free(ts->kind);
+    free(ts->start);
+    free(ts->length);
+    free(ts->line);
+    free(ts->value);
+    free(ts->floats);
+    memset(ts, 0, sizeof(*ts));
+}
@@ -8,16 +8,135 @@
 #ifndef _SCAN_H_
 #define _SCAN_H_
 #include "globals.h"
+#include "output.h"
 
 /* MAXTOKENLEN is the maximum size of a token */
 #define MAXTOKENLEN 40
 
-/* tokenString array stores the lexeme of each token */
-extern char tokenString[MAXTOKENLEN + 1];
+/* Function loadSource maps (or, for pipes, reads)
+ * the whole source file of ctx into its sourceText;
+ * it is called by getToken on first use
+ */
+int loadSource(Compiler* ctx);
+
+/* Procedure useSource makes the length bytes at
+ * text the sourceText of ctx in place of its source
+ * file; the text stays the caller's and must outlive
+ * the compilation
+ */
+void useSource(Compiler* ctx, const char* text, int length);
+
+/* Procedure closeSource releases the sourceText of ctx */
+void closeSource(Compiler* ctx);
+
+/* Scanner holds the state of one scan of a text:
+ * getToken drives one over the sourceText of a
+ * compilation, and several can run at once over
+ * separate parts of a text
+ */
+typedef struct {
+    const char* text;
+    int length;
+    int linepos; /* current position in text */
+    int bufsize; /* end of the current line in text */
+    int EOF_flag; /* corrects ungetNextChar behavior on EOF */
+    int lineno;  /* lines counted from where the scan began */
+    Output* echo; /* listing to echo each line to, or NULL */
+    /* the last token: lexeme slice of text, value
+       and malformed literal message (or NULL) */
+    int tokenStart;
+    int tokenLength;
+    int tokenValue;
+    double tokenFloat;
+    const char* error;
+    /* literal value accumulated during the scan */
+    int intValue;
+    int intOverflow;
+    double mantissa;
+    int sigDigits;
+    int decExponent;
+    int expValue;
+    int expNegative;
+} Scanner;
+
+/* Procedure scanInit prepares sc to scan text from
+ * pos, which must be the start of a line; lines are
+ * counted from there, so the first one is line 1
+ */
+void scanInit(Scanner* sc, const char* text, int length, int pos);
+
+/* Procedure scanResume prepares sc to go on scanning
+ * text from pos, right after a token of line lineno
+ * whose last character is not the end of its line
+ */
+void scanResume(Scanner* sc, const char* text, int length, int pos,
+                int lineno);
+
+/* function scanToken returns the next token in the
+ * text of sc; it does no tracing, and a malformed
+ * literal is left in sc->error instead of reported
+ */
+TokenType scanToken(Scanner* sc);
+
+/* Procedure lexError reports a malformed literal
+ * at line lineno of ctx
+ */
+void lexError(Compiler* ctx, const char* message);
 
 /* function getToken returns the
  * next token in source file
  */
-TokenType getToken(void);
+TokenType getToken(Compiler* ctx);
+
+/* TokenStream holds every token of a source program
+ * as parallel arrays indexed by token number: kind,
+ * lexeme slice of the source text, line number, and
+ * the value of NUM tokens, the atom id of ID tokens
+ * or the index in floats of FLOAT tokens.
+ * The last token is ENDFILE, the only one whose
+ * lexeme is empty
+ */
+typedef struct {
+    int count;
+    int capacity;
+    unsigned char* kind; /* TokenType */
+    int* start;
+    int* length;
+    int* line;
+    int* value;
+    double* floats; /* values of FLOAT tokens */
+    int nfloats;
+    int floatCapacity;
+    int deadFloats; /* floats of tokens since replaced */
+} TokenStream;
+
+/* Function reserveTokens makes room in ts for n
+ * tokens, doubling its capacity as needed; it
+ * returns FALSE when out of memory
+ */
+int reserveTokens(TokenStream* ts, int n);
+
+/* Function addFloat enters a FLOAT value in the
+ * side table of ts and returns its index, or -1
+ * when out of memory
+ */
+int addFloat(TokenStream* ts, double v);
+
+/* Function appendToken adds a token of the source
+ * text of ctx to ts: ID tokens are interned and FLOAT
+ * values entered in the side table; it returns FALSE
+ * when out of memory
+ */
+int appendToken(Compiler* ctx, TokenStream* ts, TokenType tok, int start,
+                int length, int line, int value, double fvalue);
+
+/* Function tokenize scans the whole source program
+ * into ts in one pass; it returns FALSE when out of
+ * memory
+ */
+int tokenize(Compiler* ctx, TokenStream* ts);
+
+/* Procedure freeTokens releases the arrays of ts */
+void freeTokens(TokenStream* ts);
 
 #endif
@@ -0,0 +1,472 @@
+/****************************************************/
+/* File: server.c                                   */
+/* Compile server: a long-running TINY compiler     */
+/* answering requests on a Unix domain socket       */
+/* A fixed pool of limit threads serves accepted    */
+/* connections one at a time, so the scanner tables */
+/* and each thread's allocator stay warm between    */
+/* requests                                         */
+/****************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "globals.h"
+#include "incr.h"
+#include "output.h"
+#include "tiny.h"
+#include "util.h"
+
+/* longest request line */
+#define MAXLINE 1024
+
+/* largest source accepted */
+#define MAXSOURCE (1 << 28)
+
+/* accepted connections waiting for a thread */
+#define QUEUESIZE 64
+
+/* latencies kept per phase for the percentiles */
+#define WINDOW 4096
+
+/* the phases timed in the statistics: those of
+   tinyCompile and the whole compilation */
+#define TOTAL TINY_PHASES
+#define NTIMED (TOTAL + 1)
+
+static const char* phaseNames[NTIMED] = {"scan", "parse", "analyze",
+                                         "code", "total"};
+
+/* Stats counts the requests and keeps the latest
+   WINDOW latencies of each phase */
+typedef struct {
+    pthread_mutex_t lock;
+    long requests; /* compile requests answered */
+    long failures; /* of which malformed or out of memory */
+    int active;    /* connections being served */
+    long timed[NTIMED]; /* latencies recorded so far */
+    double latency[NTIMED][WINDOW];
+} Stats;
+
+/* Server is the state of a running server, shared
+   by its threads */
+typedef struct {
+    int queue[QUEUESIZE]; /* accepted connections */
+    int head;
+    int count;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t nonEmpty;
+    pthread_cond_t nonFull;
+    Stats stats;
+    Cache* cache; /* or NULL */
+} Server;
+
+/* Reader buffers the input of a connection */
+typedef struct {
+    int fd;
+    int pos;
+    int len;
+    char buf[1 << 12];
+} Reader;
+
+/* fill refills the buffer of r, returning FALSE
+   at the end of input */
+static int fill(Reader* r) {
+    ssize_t n;
+    do
+        n = read(r->fd, r->buf, sizeof(r->buf));
+    while (n < 0 && errno == EINTR);
+    if (n <= 0) return FALSE;
+    r->pos = 0;
+    r->len = (int)n;
+    return TRUE;
+}
+
+/* readLine reads the next line of r into line,
+   without its end; it returns FALSE at the end of
+   input or when the line does not fit in size */
+static int readLine(Reader* r, char* line, int size) {
+    int n = 0;
+    char c;
+    for (;;) {
+        if (r->pos == r->len && !fill(r)) return FALSE;
+        c = r->buf[r->pos++];
+        if (c == '\n') break;
+        if (n == size - 1) return FALSE;
+        line[n++] = c;
+    }
+    if (n > 0 && line[n - 1] == '\r') n--;
+    line[n] = '\0';
+    return TRUE;
+}
+
+/* readBytes reads the next n bytes of r into p */
+static int readBytes(Reader* r, char* p, int n) {
+    while (n > 0) {
+        int k;
+        if (r->pos == r->len && !fill(r)) return FALSE;
+        k = r->len - r->pos < n ? r->len - r->pos : n;
+        memcpy(p, r->buf + r->pos, k);
+        r->pos += k;
+        p += k;
+        n -= k;
+    }
+    return TRUE;
+}
+
+/* reply writes an answer line and its body to fd */
+static int reply(int fd, const char* line, const char* body, int length) {
+    return writeAll(fd, line, (int)strlen(line)) &&
+           (length == 0 || writeAll(fd, body, length));
+}
+
+/* record enters the outcome of a compile request
+   in the statistics */
+static void record(Stats* st, int ok, const double* seconds) {
+    int i;
+    pthread_mutex_lock(&st->lock);
+    st->requests++;
+    if (!ok) st->failures++;
+    for (i = 0; i < NTIMED && seconds != NULL; i++)
+        if (seconds[i] > 0)
+            st->latency[i][st->timed[i]++ % WINDOW] = seconds[i];
+    pthread_mutex_unlock(&st->lock);
+}
+
+/* compareDoubles orders latencies for qsort */
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* printStats prints the request counts and the
+   latency percentiles of each phase to out */
+static void printStats(Stats* st, Cache* cache, Output* out) {
+    static const double percents[] = {50, 90, 99};
+    double sorted[WINDOW];
+    int i, j, n;
+    pthread_mutex_lock(&st->lock);
+    outPrintf(out, "requests %ld\nfailures %ld\nactive %d\n", st->requests,
+              st->failures, st->active);
+    if (cache != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        outPrintf(out, "cache %ld hits %ld misses %ld evictions\n",
+                  cache->hits, cache->misses, cache->evictions);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    outPrintf(out, "%-8s %8s %10s %10s %10s %10s\n", "phase", "count",
+              "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+    for (i = 0; i < NTIMED; i++) {
+        n = st->timed[i] < WINDOW ? (int)st->timed[i] : WINDOW;
+        outPrintf(out, "%-8s %8ld", phaseNames[i], st->timed[i]);
+        memcpy(sorted, st->latency[i], n * sizeof(double));
+        qsort(sorted, n, sizeof(double), compareDoubles);
+        /* nearest rank: the smallest latency not below
+           the given percentage of them */
+        for (j = 0; j < 3; j++)
+            outPrintf(out, " %10.1f",
+                      n ? sorted[(int)((n * percents[j] + 99) / 100) - 1] * 1e6
+                        : 0.0);
+        outPrintf(out, " %10.1f\n", n ? sorted[n - 1] * 1e6 : 0.0);
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+/* setOption sets the option of a COMPILE request
+   named word in options; it returns FALSE if there
+   is no such option */
+static int setOption(TinyOptions* options, char* word) {
+    static const struct {
+        const char* name;
+        size_t offset;
+    } flags[] = {{"noParse", offsetof(TinyOptions, noParse)},
+                 {"noAnalyze", offsetof(TinyOptions, noAnalyze)},
+                 {"noCode", offsetof(TinyOptions, noCode)},
+                 {"EchoSource", offsetof(TinyOptions, EchoSource)},
+                 {"TraceScan", offsetof(TinyOptions, TraceScan)},
+                 {"TraceParse", offsetof(TinyOptions, TraceParse)},
+                 {"TraceAnalyze", offsetof(TinyOptions, TraceAnalyze)},
+                 {"TraceCode", offsetof(TinyOptions, TraceCode)},
+                 {"fuseAnalysis", offsetof(TinyOptions, fuseAnalysis)}};
+    int i;
+    if (strncmp(word, "name=", 5) == 0) {
+        options->name = word + 5;
+        return TRUE;
+    }
+    for (i = 0; i < (int)(sizeof(flags) / sizeof(flags[0])); i++)
+        if (strcmp(word, flags[i].name) == 0) {
+            *(int*)((char*)options + flags[i].offset) = TRUE;
+            return TRUE;
+        }
+    return FALSE;
+}
+
+/* answer writes the OK answer giving result to fd */
+static int answer(int fd, const TinyResult* result) {
+    char line[MAXLINE];
+    snprintf(line, sizeof(line), "OK %d %d %d\n", result->Error,
+             result->listingLength, result->codeLength);
+    return reply(fd, line, NULL, 0) &&
+           writeAll(fd, result->listing, result->listingLength) &&
+           writeAll(fd, result->code, result->codeLength);
+}
+
+/* compileRequest answers the COMPILE request whose
+   line is args (past the keyword), or the OPEN
+   request, if program is not NULL, keeping the
+   compiled program in *program for EDIT requests;
+   it returns FALSE when the connection cannot go on */
+static int compileRequest(Server* s, Reader* r, int out, char* args,
+                          Program** program) {
+    TinyOptions options = {0};
+    TinyResult result;
+    double seconds[NTIMED], t;
+    char line[MAXLINE];
+    char* save;
+    char* word = strtok_r(args, " ", &save);
+    long length = word ? strtol(word, NULL, 10) : -1;
+    char* text;
+    int ok = TRUE;
+    if (length < 0 || length > MAXSOURCE) {
+        record(&s->stats, FALSE, NULL);
+        reply(out, "ERROR bad source length\n", NULL, 0);
+        return FALSE;
+    }
+    if ((text = malloc(length + 1)) == NULL) {
+        record(&s->stats, FALSE, NULL);
+        reply(out, "ERROR out of memory\n", NULL, 0);
+        return FALSE;
+    }
+    if (!readBytes(r, text, (int)length)) {
+        free(text);
+        return FALSE;
+    }
+    while (ok && (word = strtok_r(NULL, " ", &save)) != NULL)
+        ok = setOption(&options, word);
+    if (!ok) {
+        free(text);
+        record(&s->stats, FALSE, NULL);
+        snprintf(line, sizeof(line), "ERROR unknown option %s\n", word);
+        return reply(out, line, NULL, 0);
+    }
+    t = now();
+    if (program != NULL) {
+        closeProgram(*program);
+        *program = openProgram(text, (int)length, &options, &result);
+        ok = *program != NULL;
+    } else if (s->cache != NULL)
+        ok = cacheCompile(s->cache, text, (int)length, &options, &result);
+    else
+        ok = tinyCompile(text, (int)length, &options, &result);
+    memcpy(seconds, result.seconds, sizeof(result.seconds));
+    seconds[TOTAL] = now() - t;
+    free(text);
+    record(&s->stats, ok, seconds);
+    ok = ok ? answer(out, &result) : reply(out, "ERROR out of memory\n", NULL, 0);
+    tinyFree(&result);
+    return ok;
+}
+
+/* editRequest answers the EDIT request whose line
+   is args (past the keyword), editing program, the
+   program of the last OPEN request; it returns FALSE
+   when the connection cannot go on */
+static int editRequest(Server* s, Reader* r, int out, char* args,
+                       Program* program) {
+    TinyResult result;
+    double seconds[NTIMED], t;
+    long offset, removed, length;
+    char* text;
+    int ok;
+    if (sscanf(args, "%ld %ld %ld", &offset, &removed, &length) != 3 ||
+        offset < 0 || offset > MAXSOURCE || removed < 0 ||
+        removed > MAXSOURCE || length < 0 || length > MAXSOURCE) {
+        record(&s->stats, FALSE, NULL);
+        reply(out, "ERROR bad edit\n", NULL, 0);
+        return FALSE;
+    }
+    if ((text = malloc(length + 1)) == NULL) {
+        record(&s->stats, FALSE, NULL);
+        reply(out, "ERROR out of memory\n", NULL, 0);
+        return FALSE;
+    }
+    if (!readBytes(r, text, (int)length)) {
+        free(text);
+        return FALSE;
+    }
+    if (program == NULL) {
+        free(text);
+        record(&s->stats, FALSE, NULL);
+        return reply(out, "ERROR no program\n", NULL, 0);
+    }
+    t = now();
+    ok = editProgram(program, (int)offset, (int)removed, text, (int)length,
+                     &result);
+    memcpy(seconds, result.seconds, sizeof(result.seconds));
+    seconds[TOTAL] = now() - t;
+    free(text);
+    record(&s->stats, ok, seconds);
+    ok = ok ? answer(out, &result)
+            : reply(out, "ERROR edit failed\n", NULL, 0);
+    tinyFree(&result);
+    return ok;
+}
+
+/* serveConnection answers the requests read from
+   in on out until the end of input */
+static void serveConnection(Server* s, int in, int out) {
+    Reader r;
+    Program* program = NULL; /* of the last OPEN request */
+    char line[MAXLINE];
+    int ok = TRUE;
+    r.fd = in;
+    r.pos = r.len = 0;
+    while (ok && readLine(&r, line, sizeof(line))) {
+        if (strncmp(line, "COMPILE ", 8) == 0)
+            ok = compileRequest(s, &r, out, line + 8, NULL);
+        else if (strncmp(line, "OPEN ", 5) == 0)
+            ok = compileRequest(s, &r, out, line + 5, &program);
+        else if (strncmp(line, "EDIT ", 5) == 0)
+            ok = editRequest(s, &r, out, line + 5, program);
+        else if (strcmp(line, "STATS") == 0) {
+            Output stats = {0};
+            printStats(&s->stats, s->cache, &stats);
+            snprintf(line, sizeof(line), "STATS %d\n", stats.length);
+            ok = !stats.failed && reply(out, line, stats.text, stats.length);
+            outRelease(&stats);
+        } else
+            ok = reply(out, "ERROR unknown request\n", NULL, 0);
+    }
+    closeProgram(program);
+}
+
+/* runWorker is run by each thread of the server: it
+   serves the queued connections one after another */
+static void* runWorker(void* arg) {
+    Server* s = arg;
+    int fd;
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (s->count == 0 && !s->stopping)
+            pthread_cond_wait(&s->nonEmpty, &s->lock);
+        if (s->count == 0) {
+            pthread_mutex_unlock(&s->lock);
+            return NULL;
+        }
+        fd = s->queue[s->head];
+        s->head = (s->head + 1) % QUEUESIZE;
+        s->count--;
+        pthread_cond_signal(&s->nonFull);
+        pthread_mutex_unlock(&s->lock);
+        pthread_mutex_lock(&s->stats.lock);
+        s->stats.active++;
+        pthread_mutex_unlock(&s->stats.lock);
+        serveConnection(s, fd, fd);
+        close(fd);
+        pthread_mutex_lock(&s->stats.lock);
+        s->stats.active--;
+        pthread_mutex_unlock(&s->stats.lock);
+    }
+}
+
+/* listenOn returns a socket listening at path, or
+   -1 if it cannot be set up */
+static int listenOn(const char* path) {
+    struct sockaddr_un addr;
+    int fd;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path %s too long\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Function runServer serves compile requests on the
+ * Unix domain socket at path, or on stdin/stdout if
+ * path is "-", with at most limit connections being
+ * served at once (0: one per processor), taking
+ * the results from cache, if not NULL, when they
+ * are there; see server.h for the protocol. It
+ * returns only if the socket cannot be set up
+ * (FALSE) or, for "-", at the end of input (TRUE)
+ */
+int runServer(const char* path, int limit, Cache* cache) {
+    Server* s = calloc(1, sizeof(Server));
+    pthread_t* threads;
+    int fd, conn, started = 0, i;
+    if (s == NULL) {
+        fprintf(stderr, "Out of memory error in server\n");
+        return FALSE;
+    }
+    /* a client going away must not end the server */
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->stats.lock, NULL);
+    pthread_cond_init(&s->nonEmpty, NULL);
+    pthread_cond_init(&s->nonFull, NULL);
+    s->cache = cache;
+    if (strcmp(path, "-") == 0) {
+        serveConnection(s, 0, 1);
+        free(s);
+        return TRUE;
+    }
+    if (limit <= 0) limit = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if ((fd = listenOn(path)) < 0 ||
+        (threads = calloc(limit, sizeof(pthread_t))) == NULL) {
+        if (fd >= 0) close(fd);
+        free(s);
+        return FALSE;
+    }
+    while (started < limit &&
+           pthread_create(&threads[started], NULL, runWorker, s) == 0)
+        started++;
+    while (started > 0) {
+        conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        pthread_mutex_lock(&s->lock);
+        while (s->count == QUEUESIZE) pthread_cond_wait(&s->nonFull, &s->lock);
+        s->queue[(s->head + s->count++) % QUEUESIZE] = conn;
+        pthread_cond_signal(&s->nonEmpty);
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->stopping = TRUE;
+    pthread_cond_broadcast(&s->nonEmpty);
+    pthread_mutex_unlock(&s->lock);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    close(fd);
+    unlink(path);
+    free(threads);
+    free(s);
+    return FALSE;
+}
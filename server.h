@@ -0,0 +1,50 @@
+/****************************************************/
+/* File: server.h                                   */
+/* Compile server: a long-running TINY compiler     */
+/* answering requests on a Unix domain socket       */
+/****************************************************/
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+#include "cache.h"
+
+/* Function runServer serves compile requests on the
+ * Unix domain socket at path, or on stdin/stdout if
+ * path is "-", with at most limit connections being
+ * served at once (0: one per processor), taking
+ * the results from cache, if not NULL, when they
+ * are there.
+ * A connection carries any number of requests, each
+ * a line followed, for COMPILE, OPEN and EDIT, by
+ * the source:
+ *
+ *   COMPILE <length> [option...]    the next length
+ *                                   bytes are compiled
+ *   OPEN <length> [option...]       likewise, keeping
+ *                                   the program for EDIT
+ *   EDIT <offset> <removed> <length>
+ *                                   the removed bytes at
+ *                                   offset are replaced
+ *                                   by the next length
+ *                                   bytes, and the program
+ *                                   compiled again (see
+ *                                   editProgram)
+ *   STATS                           request counts and
+ *                                   latency percentiles
+ *
+ * The options are the names of the TinyOptions flags
+ * (noAnalyze, TraceScan, ...) and name=<file>. The
+ * answers are
+ *
+ *   OK <Error> <listing length> <code length>
+ *   STATS <length>
+ *   ERROR <message>
+ *
+ * each line followed by that many bytes of listing
+ * and code, or of statistics. It returns only if
+ * the socket cannot be set up (FALSE) or, for "-",
+ * at the end of input (TRUE)
+ */
+int runServer(const char* path, int limit, Cache* cache);
+
+#endif
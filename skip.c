@@ -0,0 +1,149 @@
+/****************************************************/
+/* File: skip.c                                     */
+/* Vectorized byte-skipping kernels used by the     */
+/* scanner to cross blanks and comments             */
+/* (SSE2 and AVX2 on x86, scalar everywhere else)   */
+/****************************************************/
+
+#include "skip.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SKIP_X86 1
+#include <immintrin.h>
+#else
+#define SKIP_X86 0
+#endif
+
+/* the scalar kernels: the reference behavior,
+   also used for the tails of the vector kernels */
+static int skipBlanksScalar(const char* s, int from, int to) {
+    while (from < to &&
+           (s[from] == ' ' || s[from] == '\t' || s[from] == '\n'))
+        from++;
+    return from;
+}
+
+static int findByteScalar(const char* s, int from, int to, int c) {
+    while (from < to && s[from] != (char)c) from++;
+    return from;
+}
+
+static int countByteScalar(const char* s, int from, int to, int c) {
+    int n = 0;
+    for (; from < to; from++) n += s[from] == (char)c;
+    return n;
+}
+
+#if SKIP_X86
+/* SSE2: 16 bytes per step. A movemask bit is set for
+   each byte that matches */
+__attribute__((target("sse2"))) static int skipBlanksSSE2(const char* s,
+                                                         int from, int to) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; from + 16 <= to; from += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + from));
+        __m128i b = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_cmpeq_epi8(v, nl));
+        unsigned m = ~(unsigned)_mm_movemask_epi8(b) & 0xffffu;
+        if (m) return from + __builtin_ctz(m);
+    }
+    return skipBlanksScalar(s, from, to);
+}
+
+__attribute__((target("sse2"))) static int findByteSSE2(const char* s,
+                                                       int from, int to,
+                                                       int c) {
+    const __m128i k = _mm_set1_epi8((char)c);
+    for (; from + 16 <= to; from += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + from));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, k));
+        if (m) return from + __builtin_ctz(m);
+    }
+    return findByteScalar(s, from, to, c);
+}
+
+__attribute__((target("sse2"))) static int countByteSSE2(const char* s,
+                                                        int from, int to,
+                                                        int c) {
+    const __m128i k = _mm_set1_epi8((char)c);
+    int n = 0;
+    for (; from + 16 <= to; from += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + from));
+        n += __builtin_popcount(
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, k)));
+    }
+    return n + countByteScalar(s, from, to, c);
+}
+
+/* AVX2: 32 bytes per step, compiled for AVX2 only
+   and called only when the CPU has it */
+__attribute__((target("avx2"))) static int skipBlanksAVX2(const char* s,
+                                                         int from, int to) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; from + 32 <= to; from += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + from));
+        __m256i b = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                            _mm256_cmpeq_epi8(v, tab)),
+            _mm256_cmpeq_epi8(v, nl));
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(b);
+        if (m) return from + __builtin_ctz(m);
+    }
+    return skipBlanksSSE2(s, from, to);
+}
+
+__attribute__((target("avx2"))) static int findByteAVX2(const char* s,
+                                                       int from, int to,
+                                                       int c) {
+    const __m256i k = _mm256_set1_epi8((char)c);
+    for (; from + 32 <= to; from += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + from));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, k));
+        if (m) return from + __builtin_ctz(m);
+    }
+    return findByteSSE2(s, from, to, c);
+}
+
+__attribute__((target("avx2"))) static int countByteAVX2(const char* s,
+                                                        int from, int to,
+                                                        int c) {
+    const __m256i k = _mm256_set1_epi8((char)c);
+    int n = 0;
+    for (; from + 32 <= to; from += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + from));
+        n += __builtin_popcount(
+            (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, k)));
+    }
+    return n + countByteSSE2(s, from, to, c);
+}
+#endif
+
+const char* skipLevel = "scalar";
+int (*skipBlanks)(const char*, int, int) = skipBlanksScalar;
+int (*findByte)(const char*, int, int, int) = findByteScalar;
+int (*countByte)(const char*, int, int, int) = countByteScalar;
+
+/* Procedure initSkip selects the SSE2, AVX2 or
+ * scalar kernels according to the running CPU
+ */
+void initSkip(void) {
+#if SKIP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        skipLevel = "avx2";
+        skipBlanks = skipBlanksAVX2;
+        findByte = findByteAVX2;
+        countByte = countByteAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        skipLevel = "sse2";
+        skipBlanks = skipBlanksSSE2;
+        findByte = findByteSSE2;
+        countByte = countByteSSE2;
+    }
+#endif
+}
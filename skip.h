@@ -0,0 +1,34 @@
+/****************************************************/
+/* File: skip.h                                     */
+/* Vectorized byte-skipping kernels used by the     */
+/* scanner to cross blanks and comments             */
+/****************************************************/
+
+#ifndef _SKIP_H_
+#define _SKIP_H_
+
+/* Procedure initSkip selects the SSE2, AVX2 or
+ * scalar kernels according to the running CPU
+ */
+void initSkip(void);
+
+/* skipLevel names the kernels selected by initSkip */
+extern const char* skipLevel;
+
+/* Function skipBlanks returns the index of the first
+ * character of s[from..to) that is not ' ', '\t' or
+ * '\n', or to if there is none
+ */
+extern int (*skipBlanks)(const char* s, int from, int to);
+
+/* Function findByte returns the index of the first
+ * occurrence of c in s[from..to), or to if none
+ */
+extern int (*findByte)(const char* s, int from, int to, int c);
+
+/* Function countByte returns the number of
+ * occurrences of c in s[from..to)
+ */
+extern int (*countByte)(const char* s, int from, int to, int c);
+
+#endif
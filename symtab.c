@@ -1,122 +1,373 @@
 /****************************************************/
 /* File: symtab.c                                   */
 /* Symbol table implementation for the TINY compiler*/
-/* (allows only one symbol table)                   */
-/* Symbol table is implemented as a chained         */
-/* hash table                                       */
+/* (one symbol table per SymTab)                    */
+/* Symbol table is implemented as an open-addressed */
+/* hash table with linear probing, over the globals */
+/* kept in order of entry and a stack of the        */
+/* bindings of the open scopes                      */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "symtab.h"
+#include "atom.h"
 
-/* SIZE is the size of the hash table */
-#define SIZE 211
+/* the slot of a name in a table of size slots (a
+   power of 2): names are interned, so their hash
+   was computed once by the atom table, and it is
+   only mixed here so that its high bits count too */
+static int slotOf ( char * name, int size )
+{ unsigned h = atomHash(name) * 2654435769u;
+  return (int)((h ^ (h >> 16)) & (unsigned)(size - 1));
+}
 
-/* SHIFT is the power of two used as multiplier
-   in hash function  */
-#define SHIFT 4
+/* The record of each variable, including name,
+ * assigned memory location, and the references
+ * to it in the source code, appended to a vector
+ * of bytes: each takes a varint of its line less
+ * the line of the one before it (zigzag coded, as
+ * lines may go back), shifted left by 2 over its
+ * kind, then a varint of its column
+ */
+typedef struct SymRec
+   { char * name;
+     int memloc ; /* memory location for variable */
+     unsigned char * refs;
+     int refBytes;
+     int refCapacity;
+     int lastLine; /* of the last reference */
+   } SymRec;
 
-/* the hash function */
-static int hash ( char * key )
-{ int temp = 0;
-  int i = 0;
-  while (key[i] != '\0')
-  { temp = ((temp << SHIFT) + key[i]) % SIZE;
-    ++i;
-  }
-  return temp;
-}
+/* the most bytes a reference takes */
+#define MAXREFBYTES 16
 
-/* the list of line numbers of the source 
- * code in which a variable is referenced
+/* The binding of a parameter or local in an open
+ * scope, with the binding of the same name that it
+ * hides, if any
  */
-typedef struct LineListRec
-   { int lineno;
-     struct LineListRec * next;
-   } * LineList;
+typedef struct SymLocal
+   { char * name;
+     int memloc ; /* location in the frame */
+     int shadowed; /* index in locals, or -1 */
+   } SymLocal;
 
-/* The record in the bucket lists for
- * each variable, including name, 
- * assigned memory location, and
- * the list of line numbers in which
- * it appears in the source code
+/* An open scope: its first binding in locals and
+ * the locations its frame takes so far
  */
-typedef struct BucketListRec
+typedef struct SymScope
+   { int firstLocal;
+     int frameSize;
+   } SymScope;
+
+/* a slot of the table: a name, kept there so that
+ * probing does not touch the entries, with its
+ * global entry and its innermost binding in an
+ * open scope (each -1 when there is none), or a
+ * NULL name for a free slot
+ */
+typedef struct SymSlot
    { char * name;
-     LineList lines;
-     int memloc ; /* memory location for variable */
-     struct BucketListRec * next;
-   } * BucketList;
-
-/* the hash table */
-static BucketList hashTable[SIZE];
-
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
- */
-void st_insert( char * name, int lineno, int loc )
-{ int h = hash(name);
-  BucketList l =  hashTable[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) /* variable not yet in table */
-  { l = (BucketList) malloc(sizeof(struct BucketListRec));
+     int global;
+     int local;
+   } SymSlot;
+
+/* growSlots doubles the slots of st and enters
+ * every name again; it returns FALSE when out
+ * of memory, st being left as it was
+ */
+static int growSlots( SymTab * st )
+{ int size = st->nSlots ? 2 * st->nSlots : 256;
+  SymSlot * slots = calloc(size, sizeof(SymSlot));
+  int i, h;
+  if (slots == NULL) return FALSE;
+  for (i=0;i<st->nSlots;++i)
+    if (st->slots[i].name != NULL)
+    { h = slotOf(st->slots[i].name,size);
+      while (slots[h].name != NULL) h = (h+1) & (size-1);
+      slots[h] = st->slots[i];
+    }
+  free(st->slots);
+  st->slots = slots;
+  st->nSlots = size;
+  return TRUE;
+} /* growSlots */
+
+/* findSlot returns the slot of name, or NULL */
+static SymSlot * findSlot( SymTab * st, char * name )
+{ int h;
+  if (st->nSlots == 0) return NULL;
+  h = slotOf(name,st->nSlots);
+  while ((st->slots[h].name != NULL) && (name != st->slots[h].name))
+    h = (h+1) & (st->nSlots-1);
+  return st->slots[h].name == NULL ? NULL : &st->slots[h];
+}
+
+/* takeSlot returns the slot of name, taking a free
+ * one for it if it has none, or NULL when out of
+ * memory
+ */
+static SymSlot * takeSlot( SymTab * st, char * name )
+{ int h;
+  if (2 * (st->nUsed + 1) > st->nSlots && !growSlots(st)) return NULL;
+  h = slotOf(name,st->nSlots);
+  while ((st->slots[h].name != NULL) && (name != st->slots[h].name))
+    h = (h+1) & (st->nSlots-1);
+  if (st->slots[h].name == NULL)
+  { st->slots[h].name = name;
+    st->slots[h].global = st->slots[h].local = -1;
+    st->nUsed++;
+  }
+  return &st->slots[h];
+}
+
+/* putVarint appends v to the references of l, 7
+   bits a byte from the lowest, the high bit of a
+   byte telling that another one follows */
+static void putVarint( SymRec * l, unsigned long long v )
+{ while (v >= 0x80)
+  { l->refs[l->refBytes++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  l->refs[l->refBytes++] = (unsigned char)v;
+}
+
+/* getVarint returns the varint at *p, moving *p
+   past it */
+static unsigned long long getVarint( const unsigned char ** p )
+{ unsigned long long v = 0;
+  int shift = 0;
+  while (**p & 0x80)
+  { v |= (unsigned long long)(*(*p)++ & 0x7f) << shift;
+    shift += 7;
+  }
+  return v | (unsigned long long)*(*p)++ << shift;
+}
+
+/* addRef appends ref to the references of l */
+static int addRef( SymRec * l, const XRef * ref )
+{ long long delta = (long long)ref->lineno - l->lastLine;
+  unsigned long long zigzag = delta < 0 ? ((unsigned long long)-delta << 1) - 1
+                                        : (unsigned long long)delta << 1;
+  if (l->refCapacity - l->refBytes < MAXREFBYTES)
+  { int cap = l->refCapacity ? 2 * l->refCapacity : 32;
+    unsigned char * refs = realloc(l->refs, cap);
+    if (refs == NULL) return FALSE;
+    l->refs = refs;
+    l->refCapacity = cap;
+  }
+  putVarint(l, zigzag << 2 | (unsigned)ref->kind);
+  putVarint(l, (unsigned)ref->column);
+  l->lastLine = ref->lineno;
+  return TRUE;
+} /* addRef */
+
+/* Function st_find_or_insert enters the reference
+ * ref to the global name in the symbol table, with
+ * memory location loc if name is not there yet,
+ * and returns the location of name (loc for a new
+ * one), or -1 when out of memory
+ * names must be interned (see atom.h): they
+ * are compared by identity
+ */
+int st_find_or_insert( SymTab * st, char * name, const XRef * ref, int loc )
+{ SymSlot * s = takeSlot(st,name);
+  SymRec * l;
+  if (s == NULL) return -1;
+  if (s->global == -1) /* variable not yet in table */
+  { if (st->nEntries == st->entryCapacity)
+    { int cap = st->entryCapacity ? 2 * st->entryCapacity : 64;
+      SymRec * entries = realloc(st->entries, cap * sizeof(SymRec));
+      if (entries == NULL) return -1;
+      st->entries = entries;
+      st->entryCapacity = cap;
+    }
+    l = &st->entries[st->nEntries];
     l->name = name;
-    l->lines = (LineList) malloc(sizeof(struct LineListRec));
-    l->lines->lineno = lineno;
     l->memloc = loc;
-    l->lines->next = NULL;
-    l->next = hashTable[h];
-    hashTable[h] = l; }
-  else /* found in table, so just add line number */
-  { LineList t = l->lines;
-    while (t->next != NULL) t = t->next;
-    t->next = (LineList) malloc(sizeof(struct LineListRec));
-    t->next->lineno = lineno;
-    t->next->next = NULL;
+    l->refs = NULL;
+    l->refBytes = l->refCapacity = l->lastLine = 0;
+    if (!addRef(l,ref)) return -1;
+    s->global = st->nEntries++;
+    return loc;
   }
-} /* st_insert */
-
-/* Function st_lookup returns the memory 
- * location of a variable or -1 if not found
- */
-int st_lookup ( char * name )
-{ int h = hash(name);
-  BucketList l =  hashTable[h];
-  while ((l != NULL) && (strcmp(name,l->name) != 0))
-    l = l->next;
-  if (l == NULL) return -1;
-  else return l->memloc;
+  /* found in table, so just add the reference */
+  l = &st->entries[s->global];
+  return addRef(l,ref) ? l->memloc : -1;
+} /* st_find_or_insert */
+
+/* startRefs sets cursor on the first reference to
+   the variable of l */
+static void startRefs( SymRec * l, RefCursor * cursor )
+{ cursor->next = l->refs;
+  cursor->end = l->refs + l->refBytes;
+  cursor->lineno = 0;
 }
 
-/* Procedure printSymTab prints a formatted 
- * listing of the symbol table contents 
- * to the listing file
+/* Function st_refs sets cursor on the first of the
+ * references to the global name, for st_next_ref;
+ * it returns FALSE if name is not in the table.
+ * The cursor stays valid until a reference to name
+ * is entered
  */
-void printSymTab(FILE * listing)
-{ int i;
-  fprintf(listing,"Variable Name  Location   Line Numbers\n");
-  fprintf(listing,"-------------  --------   ------------\n");
-  for (i=0;i<SIZE;++i)
-  { if (hashTable[i] != NULL)
-    { BucketList l = hashTable[i];
-      while (l != NULL)
-      { LineList t = l->lines;
-        fprintf(listing,"%-14s ",l->name);
-        fprintf(listing,"%-8d  ",l->memloc);
-        while (t != NULL)
-        { fprintf(listing,"%4d ",t->lineno);
-          t = t->next;
-        }
-        fprintf(listing,"\n");
-        l = l->next;
-      }
+int st_refs( SymTab * st, char * name, RefCursor * cursor )
+{ SymSlot * s = findSlot(st,name);
+  if ((s == NULL) || (s->global == -1)) return FALSE;
+  startRefs(&st->entries[s->global],cursor);
+  return TRUE;
+}
+
+/* Function st_next_ref puts the reference at cursor
+ * in ref and moves on; it returns FALSE, leaving
+ * ref as it was, when there are no more
+ */
+int st_next_ref( RefCursor * cursor, XRef * ref )
+{ unsigned long long head, zigzag;
+  if (cursor->next >= cursor->end) return FALSE;
+  head = getVarint(&cursor->next);
+  zigzag = head >> 2;
+  if (zigzag & 1) cursor->lineno -= (int)((zigzag + 1) >> 1);
+  else cursor->lineno += (int)(zigzag >> 1);
+  ref->lineno = cursor->lineno;
+  ref->column = (int)getVarint(&cursor->next);
+  ref->kind = (RefKind)(head & 3);
+  return TRUE;
+} /* st_next_ref */
+
+/* Function st_definition puts the first reference
+ * of kind DefR to the global name in ref; it returns
+ * FALSE if name is never given a value
+ */
+int st_definition( SymTab * st, char * name, XRef * ref )
+{ RefCursor cursor;
+  XRef r;
+  if (!st_refs(st,name,&cursor)) return FALSE;
+  while (st_next_ref(&cursor,&r))
+    if (r.kind == DefR)
+    { *ref = r;
+      return TRUE;
     }
+  return FALSE;
+}
+
+/* Function st_lookup returns the memory
+ * location of a variable or -1 if not found;
+ * a parameter or local of an open scope hides
+ * a global, and its location is in the frame
+ */
+int st_lookup ( SymTab * st, char * name )
+{ SymSlot * s = findSlot(st,name);
+  if (s == NULL) return -1;
+  else if (s->local != -1) return st->locals[s->local].memloc;
+  else if (s->global != -1) return st->entries[s->global].memloc;
+  else return -1;
+}
+
+/* Function st_local returns the frame location
+ * of name if it is a parameter or local of an
+ * open scope, or -1
+ */
+int st_local ( SymTab * st, char * name )
+{ SymSlot * s = findSlot(st,name);
+  if ((s == NULL) || (s->local == -1)) return -1;
+  else return st->locals[s->local].memloc;
+}
+
+/* Function st_enter_scope opens a new scope,
+ * with an empty frame, inside the open ones; it
+ * returns FALSE when out of memory
+ */
+int st_enter_scope( SymTab * st )
+{ if (st->depth == st->scopeCapacity)
+  { int cap = st->scopeCapacity ? 2 * st->scopeCapacity : 8;
+    SymScope * scopes = realloc(st->scopes, cap * sizeof(SymScope));
+    if (scopes == NULL) return FALSE;
+    st->scopes = scopes;
+    st->scopeCapacity = cap;
+  }
+  st->scopes[st->depth].firstLocal = st->nLocals;
+  st->scopes[st->depth++].frameSize = 0;
+  return TRUE;
+} /* st_enter_scope */
+
+/* Function st_declare declares name in the
+ * innermost open scope, where it takes size
+ * locations of the frame, and returns its frame
+ * location, or -1 when out of memory. A name
+ * declared again in the same scope keeps its
+ * location
+ */
+int st_declare( SymTab * st, char * name, int size )
+{ SymScope * scope = &st->scopes[st->depth-1];
+  SymSlot * s = takeSlot(st,name);
+  SymLocal * l;
+  if (s == NULL) return -1;
+  if (s->local >= scope->firstLocal) return st->locals[s->local].memloc;
+  if (st->nLocals == st->localCapacity)
+  { int cap = st->localCapacity ? 2 * st->localCapacity : 64;
+    SymLocal * locals = realloc(st->locals, cap * sizeof(SymLocal));
+    if (locals == NULL) return -1;
+    st->locals = locals;
+    st->localCapacity = cap;
+  }
+  l = &st->locals[st->nLocals];
+  l->name = name;
+  l->memloc = scope->frameSize;
+  l->shadowed = s->local;
+  if (size > INT_MAX - scope->frameSize)
+    scope->frameSize = INT_MAX; /* held rather than overflowing */
+  else
+    scope->frameSize += size;
+  s->local = st->nLocals++;
+  return l->memloc;
+} /* st_declare */
+
+/* Procedure st_exit_scope closes the innermost
+ * scope, in time proportional to what it declared:
+ * the names it hid are visible again
+ */
+void st_exit_scope( SymTab * st )
+{ int first = st->scopes[--st->depth].firstLocal;
+  while (st->nLocals > first)
+  { SymLocal * l = &st->locals[--st->nLocals];
+    findSlot(st,l->name)->local = l->shadowed;
+  }
+} /* st_exit_scope */
+
+/* Procedure printSymTab prints a formatted
+ * listing of the globals of the symbol table
+ * to the listing file, in order of entry, with
+ * the line of each of their references
+ */
+void printSymTab(SymTab * st, Output * listing)
+{ int i;
+  outPrintf(listing,"Variable Name  Location   Line Numbers\n");
+  outPrintf(listing,"-------------  --------   ------------\n");
+  for (i=0;i<st->nEntries;++i)
+  { SymRec * l = &st->entries[i];
+    RefCursor cursor;
+    XRef ref;
+    outPrintf(listing,"%-14s ",l->name);
+    outPrintf(listing,"%-8d  ",l->memloc);
+    startRefs(l,&cursor);
+    while (st_next_ref(&cursor,&ref))
+      outPrintf(listing,"%4d ",ref.lineno);
+    outPrintf(listing,"\n");
   }
 } /* printSymTab */
+
+/* Procedure freeSymTab releases every entry of st */
+void freeSymTab(SymTab * st)
+{ int i;
+  for (i=0;i<st->nEntries;++i)
+    free(st->entries[i].refs);
+  free(st->entries);
+  free(st->locals);
+  free(st->scopes);
+  free(st->slots);
+  memset(st,0,sizeof(*st));
+} /* freeSymTab */
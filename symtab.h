@@ -1,7 +1,7 @@
 /****************************************************/
 /* File: symtab.h                                   */
 /* Symbol table interface for the TINY compiler     */
-/* (allows only one symbol table)                   */
+/* (one symbol table per SymTab)                    */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -9,23 +9,129 @@
 #ifndef _SYMTAB_H_
 #define _SYMTAB_H_
 #include "globals.h"
+#include "output.h"
 
-/* Procedure st_insert inserts line numbers and
- * memory locations into the symbol table
- * loc = memory location is inserted only the
- * first time, otherwise ignored
+/* RefKind is what a reference does with a name:
+ * DefR gives it a value (an assignment or a read),
+ * UseR takes its value and CallR calls it
  */
-void st_insert(char* name, int lineno, int loc);
+typedef enum { DefR, UseR, CallR } RefKind;
+
+/* XRef is a reference to a name, at a line and
+ * column (from 1) of the source
+ */
+typedef struct {
+  int lineno;
+  int column;
+  RefKind kind;
+} XRef;
+
+/* RefCursor goes through the references to a name
+ * (see st_refs), in the order they were entered
+ */
+typedef struct {
+  const unsigned char * next;
+  const unsigned char * end;
+  int lineno; /* of the reference before next */
+} RefCursor;
+
+/* SymTab is one symbol table, open-addressed with
+ * linear probing and doubled when half full. It
+ * holds the globals, kept in order of entry, and
+ * the parameters and locals of the open scopes
+ * (one per function), which shadow the names of
+ * the scopes around them. A zeroed SymTab is empty,
+ * with no scope open
+ */
+typedef struct {
+  struct SymRec * entries; /* the globals, in order of entry */
+  int nEntries;
+  int entryCapacity;
+  /* the bindings of the open scopes, innermost
+     last: leaving a scope pops its own */
+  struct SymLocal * locals;
+  int nLocals;
+  int localCapacity;
+  struct SymScope * scopes; /* the open scopes */
+  int depth; /* number of open scopes */
+  int scopeCapacity;
+  struct SymSlot * slots; /* a power of 2 of them */
+  int nSlots;
+  int nUsed; /* slots taken */
+} SymTab;
+
+/* Function st_find_or_insert enters the reference
+ * ref to the global name in the symbol table, with
+ * memory location loc if name is not there yet,
+ * and returns the location of name (loc for a new
+ * one), or -1 when out of memory
+ * names must be interned (see atom.h): they
+ * are compared by identity
+ */
+int st_find_or_insert(SymTab* st, char* name, const XRef* ref, int loc);
+
+/* Function st_refs sets cursor on the first of the
+ * references to the global name, for st_next_ref;
+ * it returns FALSE if name is not in the table.
+ * The cursor stays valid until a reference to name
+ * is entered
+ */
+int st_refs(SymTab* st, char* name, RefCursor* cursor);
+
+/* Function st_next_ref puts the reference at cursor
+ * in ref and moves on; it returns FALSE, leaving
+ * ref as it was, when there are no more
+ */
+int st_next_ref(RefCursor* cursor, XRef* ref);
+
+/* Function st_definition puts the first reference
+ * of kind DefR to the global name in ref; it returns
+ * FALSE if name is never given a value
+ */
+int st_definition(SymTab* st, char* name, XRef* ref);
 
 /* Function st_lookup returns the memory
- * location of a variable or -1 if not found
+ * location of a variable or -1 if not found;
+ * a parameter or local of an open scope hides
+ * a global, and its location is in the frame
+ */
+int st_lookup(SymTab* st, char* name);
+
+/* Function st_local returns the frame location
+ * of name if it is a parameter or local of an
+ * open scope, or -1
+ */
+int st_local(SymTab* st, char* name);
+
+/* Function st_enter_scope opens a new scope,
+ * with an empty frame, inside the open ones; it
+ * returns FALSE when out of memory
  */
-int st_lookup(char* name);
+int st_enter_scope(SymTab* st);
+
+/* Function st_declare declares name in the
+ * innermost open scope, where it takes size
+ * locations of the frame, and returns its frame
+ * location, or -1 when out of memory. A name
+ * declared again in the same scope keeps its
+ * location
+ */
+int st_declare(SymTab* st, char* name, int size);
+
+/* Procedure st_exit_scope closes the innermost
+ * scope, in time proportional to what it declared:
+ * the names it hid are visible again
+ */
+void st_exit_scope(SymTab* st);
 
 /* Procedure printSymTab prints a formatted
- * listing of the symbol table contents
- * to the listing file
+ * listing of the globals of the symbol table
+ * to the listing file, in order of entry, with
+ * the line of each of their references
  */
-void printSymTab(FILE* listing);
+void printSymTab(SymTab* st, Output* listing);
+
+/* Procedure freeSymTab releases every entry of st */
+void freeSymTab(SymTab* st);
 
 #endif
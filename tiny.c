@@ -0,0 +1,120 @@
+/****************************************************/
+/* File: tiny.c                                     */
+/* The TINY compiler as a library (libtiny):        */
+/* runs the phases of main.c over a Compiler whose  */
+/* source and outputs are all in memory             */
+/****************************************************/
+
+#include "tiny.h"
+
+#include "analyze.h"
+#include "cgen.h"
+#include "compiler.h"
+#include "parse.h"
+#include "pgen.h"
+#include "plex.h"
+#include "util.h"
+
+/* compile runs the phases selected by options over
+   ctx, timing each in seconds; it returns FALSE when
+   out of memory */
+static int compile(Compiler* ctx, const TinyOptions* options,
+                   double* seconds) {
+    TokenStream tokens = {0};
+    Ast* syntaxTree = NULL;
+    int threads = options->threads > 0 ? options->threads : 1;
+    double t = now();
+    int ok = tokenizeParallel(ctx, &tokens, threads);
+    ctx->fuseAnalysis = options->fuseAnalysis && !options->noAnalyze;
+    seconds[TINY_SCAN] = now() - t;
+    t += seconds[TINY_SCAN];
+    if (ok && !options->noParse) {
+        syntaxTree = buildAst(&ctx->atoms, parse(ctx, &tokens));
+        arenaRelease(&ctx->arena);
+        if (syntaxTree == NULL) {
+            outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                      ctx->lineno);
+            ok = FALSE;
+        } else if (ctx->TraceParse) {
+            outPrintf(&ctx->listing, "\nSyntax tree:\n");
+            printTree(&ctx->listing, syntaxTree, syntaxTree->root);
+        }
+        seconds[TINY_PARSE] = now() - t;
+        t += seconds[TINY_PARSE];
+    }
+    if (ok && syntaxTree != NULL && !options->noAnalyze && !ctx->Error) {
+        if (ctx->TraceAnalyze)
+            outPrintf(&ctx->listing, "\nBuilding Symbol Table...\n");
+        if (ctx->fuseAnalysis)
+            buildSymtabFused(ctx);
+        else
+            buildSymtab(ctx, syntaxTree);
+        if (ctx->TraceAnalyze)
+            outPrintf(&ctx->listing, "\nChecking Types...\n");
+        if (ctx->fuseAnalysis)
+            typeCheckFused(ctx);
+        else
+            typeCheckParallel(ctx, syntaxTree, threads);
+        if (ctx->TraceAnalyze)
+            outPrintf(&ctx->listing, "\nType Checking Finished\n");
+        seconds[TINY_ANALYZE] = now() - t;
+        t += seconds[TINY_ANALYZE];
+        if (!options->noCode && !ctx->Error) {
+            char* codefile =
+                outputName(options->name ? options->name : "", ".tm");
+            if (codefile != NULL)
+                codeGenParallel(ctx, syntaxTree, codefile, threads);
+            else
+                ok = FALSE;
+            free(codefile);
+            seconds[TINY_CODE] = now() - t;
+        }
+    }
+    freeAst(syntaxTree);
+    freeTokens(&tokens);
+    return ok;
+}
+
+/* Function tinyCompile compiles the length bytes
+ * of source text into result; options may be NULL.
+ * It returns FALSE when out of memory, in which
+ * case the result is incomplete. The result must
+ * be released with tinyFree; separate compilations
+ * may run on different threads at once
+ */
+int tinyCompile(const char* text, int length, const TinyOptions* options,
+                TinyResult* result) {
+    static const TinyOptions defaults = {0};
+    Compiler ctx;
+    int ok;
+    if (options == NULL) options = &defaults;
+    memset(result->seconds, 0, sizeof(result->seconds));
+    initCompiler(&ctx, NULL, NULL);
+    ctx.EchoSource = options->EchoSource;
+    ctx.TraceScan = options->TraceScan;
+    ctx.TraceParse = options->TraceParse;
+    ctx.TraceAnalyze = options->TraceAnalyze;
+    ctx.TraceCode = options->TraceCode;
+    useSource(&ctx, text != NULL ? text : "", length);
+    if (options->name != NULL)
+        outPrintf(&ctx.listing, "\nTINY COMPILATION: %s\n", options->name);
+    ok = compile(&ctx, options, result->seconds);
+    ok = ok && !ctx.listing.failed && !ctx.code.failed;
+    result->listing = ctx.listing.text;
+    result->listingLength = ctx.listing.length;
+    result->code = ctx.code.text;
+    result->codeLength = ctx.code.length;
+    result->Error = ctx.Error;
+    /* the buffers now belong to result */
+    ctx.listing.text = ctx.code.text = NULL;
+    freeCompiler(&ctx);
+    return ok;
+}
+
+/* Procedure tinyFree releases the buffers of result */
+void tinyFree(TinyResult* result) {
+    free(result->listing);
+    free(result->code);
+    result->listing = result->code = NULL;
+    result->listingLength = result->codeLength = 0;
+}
@@ -0,0 +1,75 @@
+/****************************************************/
+/* File: tiny.h                                     */
+/* The TINY compiler as a library (libtiny):        */
+/* compiles a source program held in memory to the  */
+/* listing and TM code in memory buffers            */
+/****************************************************/
+
+#ifndef _TINY_H_
+#define _TINY_H_
+
+/* TINY_VERSION identifies the output of the compiler:
+ * it must change whenever the listing or the code of
+ * some program may change, as it keys cached results
+ */
+#define TINY_VERSION "tiny-4"
+
+/* TinyOptions selects the phases and tracing of a
+ * compilation, as the settings at the top of main.c
+ * do; zeroed options run every phase, untraced, and
+ * lex on one thread
+ */
+typedef struct {
+    int noParse;   /* scanner only */
+    int noAnalyze; /* no semantic analysis (nor code) */
+    int noCode;    /* no code generation */
+    int EchoSource;
+    int TraceScan;
+    int TraceParse;
+    int TraceAnalyze;
+    int TraceCode;
+    int threads; /* threads lexing, checking and coding (0: one) */
+    /* symbols and types analyzed by the parser as it
+       builds the tree, in one pass, for the same
+       listing and code (not by incremental programs,
+       which analyze each statement apart) */
+    int fuseAnalysis;
+    /* source file name for the listing and code
+       headers, or NULL for none */
+    const char* name;
+} TinyOptions;
+
+/* the phases of a compilation, as timed in a
+ * TinyResult
+ */
+typedef enum { TINY_SCAN, TINY_PARSE, TINY_ANALYZE, TINY_CODE, TINY_PHASES }
+TinyPhase;
+
+/* TinyResult holds the outcome of a compilation:
+ * the listing (the scan and parse traces and every
+ * diagnostic) and the TM code, each null-terminated
+ * and NULL when empty, and the time each phase took
+ */
+typedef struct {
+    char* listing;
+    int listingLength;
+    char* code;
+    int codeLength;
+    int Error; /* TRUE if the program has errors */
+    double seconds[TINY_PHASES]; /* 0 for the phases not run */
+} TinyResult;
+
+/* Function tinyCompile compiles the length bytes
+ * of source text into result; options may be NULL.
+ * It returns FALSE when out of memory, in which
+ * case the result is incomplete. The result must
+ * be released with tinyFree; separate compilations
+ * may run on different threads at once
+ */
+int tinyCompile(const char* text, int length, const TinyOptions* options,
+                TinyResult* result);
+
+/* Procedure tinyFree releases the buffers of result */
+void tinyFree(TinyResult* result);
+
+#endif
@@ -6,13 +6,23 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#define _POSIX_C_SOURCE 200809L
+
 // #include "globals.h"
 #include "util.h"
 
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "atom.h"
+#include "compiler.h"
+
 /* Procedure printToken prints a token
  * and its lexeme to the listing file
  */
-void printToken(TokenType token, const char *tokenString) {
+void printToken(Output *listing, TokenType token, const char *tokenString) {
     switch (token) {
         case IF:
         case THEN:
@@ -27,82 +37,82 @@ void printToken(TokenType token, const char *tokenString) {
         case WHILE:
         case DO:
         case RETURN:
-            fprintf(listing, "reserved word: %s\n", tokenString);
+            outPrintf(listing, "reserved word: %s\n", tokenString);
             break;
         case ASSIGN:
-            fprintf(listing, ":=\n");
+            outPrintf(listing, ":=\n");
             break;
         case LT:
-            fprintf(listing, "<\n");
+            outPrintf(listing, "<\n");
             break;
         case EQ:
-            fprintf(listing, "=\n");
+            outPrintf(listing, "=\n");
             break;
         case LPAREN:
-            fprintf(listing, "(\n");
+            outPrintf(listing, "(\n");
             break;
         case RPAREN:
-            fprintf(listing, ")\n");
+            outPrintf(listing, ")\n");
             break;
         case SEMI:
-            fprintf(listing, ";\n");
+            outPrintf(listing, ";\n");
             break;
         case PLUS:
-            fprintf(listing, "+\n");
+            outPrintf(listing, "+\n");
             break;
         case MINUS:
-            fprintf(listing, "-\n");
+            outPrintf(listing, "-\n");
             break;
         case TIMES:
-            fprintf(listing, "*\n");
+            outPrintf(listing, "*\n");
             break;
         case OVER:
-            fprintf(listing, "/\n");
+            outPrintf(listing, "/\n");
             break;
             /* 添加逗号以及中括号 */
         case COMMA:
-            fprintf(listing, ",\n");
+            outPrintf(listing, ",\n");
             break;
         case LSQU:
-            fprintf(listing, "[\n");
+            outPrintf(listing, "[\n");
             break;
         case RSQU:
-            fprintf(listing, "]\n");
+            outPrintf(listing, "]\n");
             break;
         case ENDFILE:
-            fprintf(listing, "EOF\n");
+            outPrintf(listing, "EOF\n");
             break;
         case NUM:
-            fprintf(listing, "NUM, val= %s\n", tokenString);
+            outPrintf(listing, "NUM, val= %s\n", tokenString);
             break;
         case ID:
-            fprintf(listing, "ID, name= %s\n", tokenString);
+            outPrintf(listing, "ID, name= %s\n", tokenString);
             break;
         case ERROR:
-            fprintf(listing, "ERROR: %s\n", tokenString);
+            outPrintf(listing, "ERROR: %s\n", tokenString);
             break;
         case FLOAT:
-            fprintf(listing, "FLOAT, val= %s\n", tokenString);
+            outPrintf(listing, "FLOAT, val= %s\n", tokenString);
             break;
         default: /* should never happen */
-            fprintf(listing, "Unknown token: %d\n", token);
+            outPrintf(listing, "Unknown token: %d\n", token);
     }
 }
 
 /* Function newStmtNode creates a new statement
  * node for syntax tree construction
  */
-TreeNode *newStmtNode(StmtKind kind) {
-    TreeNode *t = (TreeNode *)malloc(sizeof(TreeNode));
-    int i;
+TreeNode *newStmtNode(Compiler *ctx, StmtKind kind) {
+    TreeNode *t = (TreeNode *)arenaAlloc(&ctx->arena, sizeof(TreeNode));
     if (t == NULL)
-        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
     else {
-        for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
-        t->sibling = NULL;
+        memset(t, 0, sizeof(TreeNode));
         t->nodekind = StmtK;
         t->kind.stmt = kind;
-        t->lineno = lineno;
+        t->lineno = ctx->lineno;
+        t->column = ctx->column;
     }
     return t;
 }
@@ -110,23 +120,19 @@ TreeNode *newStmtNode(StmtKind kind) {
 /* Function newExpNode creates a new expression
  * node for syntax tree construction
  */
-TreeNode *newExpNode(ExpKind kind) {
-    TreeNode *t = (TreeNode *)malloc(sizeof(TreeNode));
-    int i;
+TreeNode *newExpNode(Compiler *ctx, ExpKind kind) {
+    TreeNode *t = (TreeNode *)arenaAlloc(&ctx->arena, sizeof(TreeNode));
     if (t == NULL)
-        fprintf(listing, "Out of memory error at line %d\n", lineno);
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
     else {
-        for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
-        t->sibling = NULL;
+        /* the attribute arrays are left NULL: the parser
+           allocates them sized once their length is known */
+        memset(t, 0, sizeof(TreeNode));
         t->nodekind = ExpK;
         t->kind.exp = kind;
-        t->lineno = lineno;
-        t->attr.dem = (int *)malloc(MAX_DEM * sizeof(int));
-        t->attr.pos = 0;
-        t->attr.init_val = (int *)malloc(MAX_NUM * sizeof(int));
-        t->attr.ipos = 0;
-        t->attr.invo = (char **)malloc(MAX_DEM * sizeof(char *));
-        t->attr.ppos = 0;
+        t->lineno = ctx->lineno;
+        t->column = ctx->column;
         t->type = Void;
     }
     return t;
@@ -135,171 +141,204 @@ TreeNode *newExpNode(ExpKind kind) {
 /* Function copyString allocates and makes a new
  * copy of an existing string
  */
-char *copyString(char *s) {
-    int n;
+char *copyString(Compiler *ctx, char *s) {
     char *t;
     if (s == NULL) return NULL;
-    n = strlen(s) + 1;
-    t = malloc(n);
+    t = arenaString(&ctx->arena, s, strlen(s));
     if (t == NULL)
-        fprintf(listing, "Out of memory error at line %d\n", lineno);
-    else
-        strcpy(t, s);
+        outPrintf(&ctx->listing, "Out of memory error at line %d\n",
+                  ctx->lineno);
     return t;
 }
 
-/* Variable indentno is used by printTree to
- * store current number of spaces to indent
- */
-static int indentno = 0;
-
-/* macros to increase/decrease indentation */
-#define INDENT indentno += 2
-#define UNINDENT indentno -= 2
-
-/* printSpaces indents by printing spaces */
-static void printSpaces(void) {
+/* printSpaces indents a node nested in depth others */
+static void printSpaces(Output *listing, int depth) {
     int i;
-    for (i = 0; i < indentno; i++) fprintf(listing, " ");
+    for (i = 0; i < 2 * (depth + 1); i++) outPrintf(listing, " ");
+}
+
+/* printNode prints one node of the syntax tree to
+   the listing file arg, indented by its depth */
+static void printNode(Ast *ast, AstRef tree, int depth, void *arg) {
+    Output *listing = arg;
+    const int *v;
+    int n, i;
+    printSpaces(listing, depth);
+    if (astNodeKind(ast, tree) == StmtK) {
+        switch (astStmtKind(ast, tree)) {
+            case IfK:
+                outPrintf(listing, "If\n");
+                break;
+            case RepeatK:
+                outPrintf(listing, "Repeat\n");
+                break;
+            case AssignK:
+                outPrintf(listing, "Assign to: %s\n", astName(ast, tree));
+                break;
+            case ReadK:
+                outPrintf(listing, "Read: %s\n", astName(ast, tree));
+                break;
+            case WriteK:
+                outPrintf(listing, "Write\n");
+                break;
+            case WhileK:
+                outPrintf(listing, "While\n");
+                break;
+            case ReturnK:
+                outPrintf(listing, "Return\n");
+                break;
+            case FuncK:
+                outPrintf(listing, "Function: %s\n", astName(ast, tree));
+                break;
+            case TypeK:
+                outPrintf(listing, "Type: %s\n", astTypeName(ast, tree));
+                break;
+            case BodyK:
+                outPrintf(listing, "Function-Body: \n");
+                break;
+            case ListK:
+                outPrintf(listing, "Parameter-List: \n");
+                break;
+            case DeclareK:
+                outPrintf(listing, "Declare: \n");
+                break;
+            case IdListK:
+                outPrintf(listing, "Variable-List: \n");
+                break;
+            default:
+                outPrintf(listing, "Unknown ExpNode kind\n");
+                break;
+        }
+    } else if (astNodeKind(ast, tree) == ExpK) {
+        switch (astExpKind(ast, tree)) {
+            case OpK:
+                outPrintf(listing, "Op: ");
+                printToken(listing, astOp(ast, tree), "\0");
+                break;
+            case ConstK:
+                outPrintf(listing, "Const: %d\n", astVal(ast, tree));
+                break;
+            case IdK:
+                outPrintf(listing, "Id: %s\n", astName(ast, tree));
+                break;
+            case ParamK:
+                outPrintf(listing, "Param (%s): %s\n", astName(ast, tree),
+                          astTypeName(ast, tree));
+                break;
+            case ArrCK:
+                outPrintf(listing, "Array-Call: %s", astName(ast, tree));
+                n = astSubscripts(ast, tree, &v);
+                for (i = 0; i < n; i++)
+                    outPrintf(listing, "[%s]", astAtom(ast, v[i]));
+                outPrintf(listing, "\n");
+                break;
+            case FunCK:
+                outPrintf(listing, "Function-Call: \n");
+                break;
+            case VarK:
+                outPrintf(listing, "Var (%s): uninitialized\n",
+                          astName(ast, tree));
+                break;
+            case VarInK:
+                if (astTypeName(ast, tree)) {
+                    outPrintf(listing, "Var (%s): %s\n", astName(ast, tree),
+                              astTypeName(ast, tree));
+                } else {
+                    outPrintf(listing, "Var (%s): %d\n", astName(ast, tree),
+                              astVal(ast, tree));
+                }
+                break;
+            case ArrK:
+            case ArrInK:
+                outPrintf(listing, "Array (%s", astName(ast, tree));
+                n = astDims(ast, tree, &v);
+                for (i = 0; i < n; i++) outPrintf(listing, "[%d]", v[i]);
+                if (astExpKind(ast, tree) == ArrK) {
+                    outPrintf(listing, "): uninitialized\n");
+                    break;
+                }
+                outPrintf(listing, "): initialized with: {");
+                n = astInits(ast, tree, &v);
+                for (i = 0; i < n; i++)
+                    outPrintf(listing, i < n - 1 ? "%d, " : "%d}", v[i]);
+                outPrintf(listing, "\n");
+                break;
+            default:
+                outPrintf(listing, "Unknown ExpNode kind\n");
+                break;
+        }
+    } else
+        outPrintf(listing, "Unknown node kind\n");
 }
 
 /* procedure printTree prints a syntax tree to the
  * listing file using indentation to indicate subtrees
  */
-char *str, *ss;
-void printTree(TreeNode *tree) {
-    int i;
-    INDENT;
-    while (tree != NULL) {
-        printSpaces();
-        if (tree->nodekind == StmtK) {
-            switch (tree->kind.stmt) {
-                case IfK:
-                    fprintf(listing, "If\n");
-                    break;
-                case RepeatK:
-                    fprintf(listing, "Repeat\n");
-                    break;
-                case AssignK:
-                    fprintf(listing, "Assign to: %s\n", tree->attr.name);
-                    break;
-                case ReadK:
-                    fprintf(listing, "Read: %s\n", tree->attr.name);
-                    break;
-                case WriteK:
-                    fprintf(listing, "Write\n");
-                    break;
-                case WhileK:
-                    fprintf(listing, "While\n");
-                    break;
-                case ReturnK:
-                    fprintf(listing, "Return\n");
-                    break;
-                case FuncK:
-                    fprintf(listing, "Function: %s\n", tree->attr.name);
-                    break;
-                case TypeK:
-                    fprintf(listing, "Type: %s\n", tree->attr.type);
-                    break;
-                case BodyK:
-                    fprintf(listing, "Function-Body: \n");
-                    break;
-                case ListK:
-                    fprintf(listing, "Parameter-List: \n");
-                    break;
-                case DeclareK:
-                    fprintf(listing, "Declare: \n");
-                    break;
-                case IdListK:
-                    fprintf(listing, "Variable-List: \n");
-                    break;
-                default:
-                    fprintf(listing, "Unknown ExpNode kind\n");
-                    break;
-            }
-        } else if (tree->nodekind == ExpK) {
-            switch (tree->kind.exp) {
-                case OpK:
-                    fprintf(listing, "Op: ");
-                    printToken(tree->attr.op, "\0");
-                    break;
-                case ConstK:
-                    fprintf(listing, "Const: %d\n", tree->attr.val);
-                    break;
-                case IdK:
-                    fprintf(listing, "Id: %s\n", tree->attr.name);
-                    break;
-                case ParamK:
-                    fprintf(listing, "Param (%s): %s\n", tree->attr.name,
-                            tree->attr.type);
-                    break;
-                case ArrCK:
-                    str = (char *)malloc(BUF_SIZE);
-                    memset(str, 0, sizeof(str));
-                    for (int i = 0; i < tree->attr.ppos; i++) {
-                        sprintf(str + strlen(str), "[%s]", tree->attr.invo[i]);
-                    }
-                    fprintf(listing, "Array-Call: %s%s\n", tree->attr.name,
-                            str);
-                    break;
-                case FunCK:
-                    fprintf(listing, "Function-Call: \n");
-                    break;
-                case VarK:
-                    fprintf(listing, "Var (%s): uninitialized\n",
-                            tree->attr.name);
-                    break;
-                case VarInK:
-                    if (tree->attr.type) {
-                        fprintf(listing, "Var (%s): %s\n", tree->attr.name,
-                                tree->attr.type);
-                    } else {
-                        fprintf(listing, "Var (%s): %d\n", tree->attr.name,
-                                tree->attr.val);
-                    }
-                    break;
-                case ArrK:
-                    str = (char *)malloc(BUF_SIZE);
-                    memset(str, 0, sizeof(str));
-                    for (int i = 0; i < tree->attr.pos; i++) {
-                        sprintf(str + strlen(str), "[%d]", tree->attr.dem[i]);
-                    }
-                    fprintf(listing, "Array (%s%s): uninitialized\n",
-                            tree->attr.name, str);
-                    free(str);
-                    break;
-                case ArrInK:
-                    str = (char *)malloc(BUF_SIZE);
-                    memset(str, 0, sizeof(str));
-                    for (int i = 0; i < tree->attr.pos; i++) {
-                        sprintf(str + strlen(str), "[%d]", tree->attr.dem[i]);
-                    }
+void printTree(Output *listing, Ast *ast, AstRef tree) {
+    if (!astWalk(ast, tree, printNode, NULL, listing))
+        outPrintf(listing, "Out of memory error in printTree\n");
+}
 
-                    ss = (char *)malloc(BUF_SIZE);
-                    memset(ss, 0, sizeof(ss));
-                    sprintf(ss + strlen(ss), "initialized with: {");
-                    for (int i = 0; i < tree->attr.ipos - 1; i++) {
-                        sprintf(ss + strlen(ss), "%d, ",
-                                tree->attr.init_val[i]);
-                    }
-                    if (tree->attr.ipos - 1 >= 0) {
-                        sprintf(ss + strlen(ss), "%d}",
-                                tree->attr.init_val[tree->attr.ipos - 1]);
-                    }
+/* Function readFile reads the whole file name into
+ * one malloc'd buffer; it returns NULL when the file
+ * cannot be read or memory runs out
+ */
+char *readFile(const char *name, int *length) {
+    FILE *f = fopen(name, "rb");
+    int cap = 1 << 12, n = 0;
+    size_t got;
+    char *buf;
+    if (f == NULL) return NULL;
+    buf = malloc(cap);
+    while (buf != NULL && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += (int)got;
+        if (n == cap) {
+            char *nbuf = realloc(buf, cap *= 2);
+            if (nbuf == NULL) free(buf);
+            buf = nbuf;
+        }
+    }
+    fclose(f);
+    *length = n;
+    return buf;
+}
 
-                    fprintf(listing, "Array (%s%s): %s\n", tree->attr.name, str,
-                            ss);
-                    free(str);
-                    free(ss);
-                    break;
-                default:
-                    fprintf(listing, "Unknown ExpNode kind\n");
-                    break;
-            }
-        } else
-            fprintf(listing, "Unknown node kind\n");
-        for (i = 0; i < MAXCHILDREN; i++) printTree(tree->child[i]);
-        tree = tree->sibling;
+/* Function now returns a monotonic time in seconds */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Function writeAll writes the n bytes at p to the
+ * file descriptor fd, going on after partial and
+ * interrupted writes; it returns FALSE on error
+ */
+int writeAll(int fd, const char *p, long n) {
+    while (n > 0) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return FALSE;
+        p += k;
+        n -= k;
+    }
+    return TRUE;
+}
+
+/* Function outputName names an output file of the
+ * source file name, replacing the extension of its
+ * last path component by ext (.tm for the code,
+ * .ast for the syntax tree); it returns NULL when
+ * out of memory
+ */
+char *outputName(const char *name, const char *ext) {
+    const char *slash = strrchr(name, '/');
+    const char *dot = strrchr(slash ? slash : name, '.');
+    int len = dot ? (int)(dot - name) : (int)strlen(name);
+    char *s = malloc(len + strlen(ext) + 1);
+    if (s != NULL) {
+        memcpy(s, name, len);
+        strcpy(s + len, ext);
     }
-    UNINDENT;
+    return s;
 }
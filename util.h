@@ -7,31 +7,57 @@
 
 #ifndef _UTIL_H_
 #define _UTIL_H_
+#include "ast.h"
 #include "globals.h"
+#include "output.h"
 
 /* Procedure printToken prints a token
  * and its lexeme to the listing file
  */
-void printToken(TokenType, const char*);
+void printToken(Output*, TokenType, const char*);
 
 /* Function newStmtNode creates a new statement
- * node for syntax tree construction
+ * node for syntax tree construction; tree nodes
+ * are allocated in the arena (see arena.h)
  */
-TreeNode* newStmtNode(StmtKind);
+TreeNode* newStmtNode(Compiler*, StmtKind);
 
 /* Function newExpNode creates a new expression
  * node for syntax tree construction
  */
-TreeNode* newExpNode(ExpKind);
+TreeNode* newExpNode(Compiler*, ExpKind);
 
-/* Function copyString allocates and makes a new
- * copy of an existing string
+/* Function copyString makes a new copy of an
+ * existing string in the arena
  */
-char* copyString(char*);
+char* copyString(Compiler*, char*);
 
 /* procedure printTree prints a syntax tree to the
  * listing file using indentation to indicate subtrees
  */
-void printTree(TreeNode*);
+void printTree(Output*, Ast*, AstRef);
+
+/* Function readFile reads the whole file name into
+ * one malloc'd buffer; it returns NULL when the file
+ * cannot be read or memory runs out
+ */
+char* readFile(const char* name, int* length);
+
+/* Function now returns a monotonic time in seconds */
+double now(void);
+
+/* Function writeAll writes the n bytes at p to the
+ * file descriptor fd, going on after partial and
+ * interrupted writes; it returns FALSE on error
+ */
+int writeAll(int fd, const char* p, long n);
+
+/* Function outputName names an output file of the
+ * source file name, replacing the extension of its
+ * last path component by ext (.tm for the code,
+ * .ast for the syntax tree); it returns NULL when
+ * out of memory
+ */
+char* outputName(const char* name, const char* ext);
 
 #endif